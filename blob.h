@@ -28,6 +28,21 @@
  * 
  * You can define `BLOB_MEMSET` to replace memset.
  * 
+ * Labels are stored as `int16_t` and coordinates as `int16_t` by default,
+ * which limits an image to 32766 blobs and 32767 pixels per side. Define
+ * `BLOB_LABEL_TYPE` and/or `BLOB_COORD_TYPE` (for example to `int32_t`)
+ * before every include of this file to lift these limits. Both types must
+ * be signed.
+ * 
+ * The raster scan skips background pixels 16 or 32 at a time using SSE2,
+ * AVX2 or NEON when the compiler targets one of these instruction sets.
+ * Define `BLOB_NO_SIMD` to only use the scalar code.
+ *
+ * Define `BLOB_STATS` where the implementation is included to record
+ * counters (pixels visited, contours traced, tracer steps, reallocations)
+ * and the time spent in each phase in `blob_context_t::stats`. The
+ * counters are reset by each call and stay 0 otherwise.
+ * 
  * Errors messages (out of memory, invalid arguments) are displayed via
  * `BLOB_ERROR`. By default this macro uses fprintf (hence adding a
  * dependency to stdio.h). `BLOB_ERROR` can be defined to replace the
@@ -36,9 +51,9 @@
  * Usage:
  * ------
  ```
- * int find_blobs( int16_t roi_x, int16_t roi_y, int16_t roi_w, int16_t roi_h,
- *                 uint8_t *in, int16_t in_w, int16_t in_h, 
- *                 label_t **label, int16_t *label_w, int16_t *label_h, 
+ * int find_blobs( blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+ *                 uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, 
+ *                 label_t **label, blob_coord_t *label_w, blob_coord_t *label_h, 
  *                 blob_t** blobs, int *count, int extract_internal );
  ```
  *  
@@ -72,6 +87,143 @@
  * 
  * `find_blobs` returns 1 upon success or 0 if an error occured.
  * 
+ * Reusing buffers:
+ * ----------------
+ * `find_blobs` allocates a new label buffer and a new blob array on each
+ * call. When processing a stream of images, a `blob_context_t` can be used
+ * instead. It owns the label buffer, the blob array and the contour point
+ * arrays, which are kept from one call to the next and only grown when
+ * needed.
+ ```
+ * blob_context_t ctx;
+ * blob_context_init(&ctx);
+ * while(...)
+ * {
+ *     if(find_blobs_ctx(&ctx, roi_x, roi_y, roi_w, roi_h, in, in_w, in_h, BLOB_EXTRACT_INTERNAL))
+ *     {
+ *         // use ctx.label, ctx.label_w, ctx.label_h, ctx.blobs and ctx.count
+ *     }
+ * }
+ * blob_context_destroy(&ctx);
+ ```
+ * The label buffer and the blobs stored in the context are only valid
+ * until the next call to `find_blobs_ctx`, `blob_context_reset` or
+ * `blob_context_destroy`. They must not be freed by the caller.
+ * As the internal contour arrays are kept between calls, `blob_t::internal`
+ * may not be NULL even if `BLOB_EXTRACT_INTERNAL` was not set. In this case,
+ * only `internal_count` is meaningful.
+ * 
+ * The `flags` parameter of `find_blobs_ctx` is a combination of:
+ *  - `BLOB_EXTRACT_INTERNAL`: store internal contour points (like
+ *    `extract_internal` for `find_blobs`).
+ *  - `BLOB_NO_EXTERNAL_POINTS`: do not store external contour points.
+ *  - `BLOB_NO_LABELS`: only write contour pixels to the label buffer.
+ *  - `BLOB_FEATURES`: compute the area, bounding box and first order
+ *    moments (hence the centroid) of each blob in `blob_t::features`.
+ *  - `BLOB_SECOND_ORDER`: also compute the second order moments.
+ *  - `BLOB_CHAIN_CODES`: store each contour as its first point followed by
+ *    one 3 bits direction code per step (see `contour_decode`), which is
+ *    about 10 times smaller than the points for long contours.
+ *  - `BLOB_ERASE_FILTERED`: clear the labels of the blobs discarded by
+ *    `ctx.min_area` or `ctx.min_perimeter` and renumber the other ones.
+ *  - `BLOB_COUNT_HOLES`: count the holes of each blob from its Euler number
+ *    instead of tracing them, which is much faster for perforated blobs.
+ *  - `BLOB_TWO_PASS`: only label the blobs with a two-pass union-find
+ *    labelling, which does not jump across rows like the contour tracer.
+ *  - `BLOB_SIMPLIFY`: drop the points in the middle of straight runs of
+ *    the contours while they are traced.
+ *  - `BLOB_CONTOUR_TREE`: link each blob to the hole of the blob it lies
+ *    in, so the nesting does not need to be computed from the contours.
+ * 
+ * Skipping the contour points and the label writes gives a cheaper pass
+ * when only the number of blobs, their holes or their features are needed.
+ * The features are accumulated during the labelling pass, so the label
+ * buffer does not need to be scanned again.
+ * 
+ * Small blobs can be discarded by setting `ctx.min_perimeter` (number of
+ * points of the external contour) and/or `ctx.min_area` (number of pixels)
+ * after `blob_context_init`. They are still labelled, but are not returned
+ * in `ctx.blobs`. A blob with a too short external contour is detected as
+ * soon as this contour is traced: its points are released and its holes
+ * are not stored. The area is only known once the labelling is done, so it
+ * implies `BLOB_FEATURES`. `find_blobs_cb` does not call back for the blobs
+ * discarded by their perimeter. A stream applies the filters set in
+ * `stream.ctx`, and does not even trace the blobs discarded by their area.
+ * 
+ * By default, a context stores the points of all the contours found by a
+ * call to `find_blobs_ctx` in a single pool (`ctx.points`). Each contour
+ * references its points by an offset and a count in this pool, and
+ * `contour_t::points` points directly into it once `find_blobs_ctx`
+ * returns. The pool is bump allocated and released in one shot by the next
+ * call. Setting `ctx.arena` to 0 after `blob_context_init` switches back to
+ * one point array per contour.
+ * 
+ * `find_blobs_cb` passes each contour to a callback as soon as it is
+ * traced instead of storing it, so tiny blobs can be filtered and contours
+ * serialized without keeping every point in memory.
+ * 
+ * `blob_file_write` stores the blobs and their contours as a binary blob
+ * set (a header, a blob table, a contour table and a point pool) in a
+ * single buffer. `blob_file_open` reads it back from a memory mapped file
+ * without copying anything.
+ * 
+ * Binary images can also be passed as 1 bit per pixel bitmaps with
+ * `find_blobs_1bpp_ctx` or as run-length encoded rows with
+ * `find_blobs_rle_ctx`. Background pixels are then skipped a word or a run
+ * at a time.
+ * 
+ * Multi-threading:
+ * ----------------
+ * `find_blobs_mt_ctx` splits the ROI into horizontal strips labelled on
+ * their own thread. The blobs touching the boundary between 2 strips are
+ * merged and traced again over the rows they span, so the result is the
+ * same as the one of `find_blobs_ctx` (except for some background pixels
+ * marked with -1 near the boundaries). This pays off when most blobs are
+ * small compared to the strips. The merged blobs are traced again by a
+ * single thread, so large blobs spanning several strips are not sped up.
+ * A first pass merging the runs of each strip finds the rows they span,
+ * and when these cover at least half of the ROI it is labelled by a
+ * single thread before any strip is traced. Define `BLOB_THREADS` where
+ * the implementation is included to enable the threads (pthreads, or the
+ * Win32 API on Windows). Otherwise the strips are labelled one after the
+ * other.
+ * `BLOB_MIN_STRIP_ROWS` (32 by default) is the minimum height of a strip.
+ * 
+ * Many small images can be processed at once with `find_blobs_batch_ctx`.
+ * Each thread labels the jobs it picks with its own workspace, straight
+ * into per job blob storage kept in the context until the next call.
+ * 
+ * Streaming:
+ * ----------
+ * Images delivered one row at a time (line-scan cameras) can be labelled
+ * with a `blob_stream_t`.
+ ```
+ * blob_stream_t stream;
+ * blob_stream_init(&stream);
+ * blob_stream_begin(&stream, width, BLOB_EXTRACT_INTERNAL, callback, user);
+ * while(...)
+ * {
+ *     blob_stream_push_rows(&stream, rows, count, stride);
+ * }
+ * blob_stream_finish(&stream);
+ * blob_stream_destroy(&stream);
+ ```
+ * The callback is called as soon as a blob is closed. The stream only keeps
+ * the runs of the blobs still open. A closed blob is drawn on a bitmap
+ * covering its bounding box to trace its contours, so the memory needed
+ * depends on the width of the image and on the size of the largest blob.
+ * Rows are numbered with `blob_coord_t`, so a stream holds at most
+ * `BLOB_COORD_MAX - 1` rows (32766 by default). Longer line-scan streams
+ * must be split into several images, or use 32 bits coordinates.
+ * 
+ * Incremental labelling:
+ * ----------------------
+ * When consecutive frames of a video only differ in a few places,
+ * `find_blobs_update_ctx` updates the results of the previous frame from
+ * a list of dirty rectangles. Only the blobs touching these rectangles
+ * are labelled again. The other ones keep their label and their contours,
+ * so the blobs are no longer stored in raster order.
+ * 
  * Note:
  * -----
  * The memory management is far from being optimal. 
@@ -81,33 +233,200 @@
 #ifndef BLOB_INCLUDE_H
 #define BLOB_INCLUDE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#if !defined(BLOB_LABEL_TYPE)
+#define BLOB_LABEL_TYPE int16_t
+#endif
+
+#if !defined(BLOB_COORD_TYPE)
+#define BLOB_COORD_TYPE int16_t
+#endif
+
 /** 
  * Type for label buffer.
+ * It can be changed by defining `BLOB_LABEL_TYPE` before including this
+ * file, for example to `int32_t` when an image may contain more than 32766
+ * blobs. 
+ * @warning The type must be signed.
+ */
+typedef BLOB_LABEL_TYPE label_t;
+
+/**
+ * Type for coordinates and dimensions.
+ * It can be changed by defining `BLOB_COORD_TYPE` before including this
+ * file, for example to `int32_t` for images wider or taller than 32767
+ * pixels.
  * @warning The type must be signed.
  */
-typedef int16_t label_t;
+typedef BLOB_COORD_TYPE blob_coord_t;
+
+/** Largest label value. **/
+#define BLOB_LABEL_MAX ((label_t)((((uint64_t)1) << ((sizeof(label_t) * 8) - 1)) - 1))
+
+/** Largest coordinate value. **/
+#define BLOB_COORD_MAX ((blob_coord_t)((((uint64_t)1) << ((sizeof(blob_coord_t) * 8) - 1)) - 1))
+
+/** 
+ * Store the points of internal contours.
+ * This is the flag equivalent of the `extract_internal` parameter of
+ * `find_blobs`. If it is not set, only the number of internal contours of
+ * each blob is computed.
+ */
+#define BLOB_EXTRACT_INTERNAL   0x01
+/** 
+ * Do not store the points of external contours.
+ * The external contours are still traced as they are needed to label the
+ * blobs, but no point storage is allocated for them.
+ */
+#define BLOB_NO_EXTERNAL_POINTS 0x02
+/** 
+ * Only label contour pixels.
+ * The pixels inside the blobs are not written to the label buffer. Only
+ * the pixels of the external and internal contours, and the background
+ * pixels around them are labelled. Use this flag when the label buffer
+ * is only needed as a workspace.
+ */
+#define BLOB_NO_LABELS          0x04
+/**
+ * Compute the area, the bounding box and the first order moments of each
+ * blob (see `blob_features_t`).
+ */
+#define BLOB_FEATURES           0x08
+/**
+ * Also compute the second order moments of each blob. 
+ * This flag implies `BLOB_FEATURES`.
+ */
+#define BLOB_SECOND_ORDER       0x10
+/**
+ * Store contours as chain codes.
+ * Only the first point of each contour is stored in `contour_t::points`.
+ * The following points are given by the direction of each step, stored in
+ * `contour_t::codes` (see `contour_decode`). This flag requires the arena
+ * mode.
+ */
+#define BLOB_CHAIN_CODES        0x20
+/**
+ * Clear the labels of the blobs discarded by `blob_context_t::min_area`
+ * or `blob_context_t::min_perimeter`.
+ * The remaining blobs are renumbered so that the label of `blobs[i]` is
+ * `i+1`. Otherwise the discarded blobs stay labelled and the other blobs
+ * keep their label.
+ */
+#define BLOB_ERASE_FILTERED     0x40
+/**
+ * Count the holes of each blob without tracing them.
+ * The blobs are labelled by merging the runs of foreground pixels, and
+ * the number of holes of a blob is given by its Euler number (number of
+ * runs minus number of pairs of 8-connected runs on adjacent rows, which
+ * is 1 minus the number of holes). Only the external contours are traced,
+ * so the background pixels inside the holes are not marked with -1, and
+ * with `BLOB_NO_LABELS` only the external contours and the first pixel of
+ * each run are labelled. This flag can not be combined with `BLOB_EXTRACT_INTERNAL` and is not
+ * supported for multi-class images.
+ */
+#define BLOB_COUNT_HOLES        0x80
+/**
+ * The ROI is surrounded by a 1 pixel wide background border
+ * (`find_blobs_stride_ctx` only).
+ * The border must be inside the input image and all its pixels must be 0.
+ * The contour tracer then never needs to check whether a neighbour is
+ * inside the ROI. If a label buffer is given, the labels of the border
+ * around the ROI must be writable too, and are set to -1.
+ */
+#define BLOB_PADDED             0x100
+/**
+ * Only label the blobs, with a two-pass union-find labelling.
+ * The first pass merges the runs of foreground pixels with the
+ * 8-connected runs of the previous row, and the second one writes the
+ * labels. Unlike the contour tracer, both passes access the image and the
+ * label buffer row after row. The labels and the order of the blobs are
+ * the same as with the contour tracing scan, but no contour is traced:
+ * `external` is empty, the perimeter is 0 and the background pixels are
+ * not marked with -1. `internal_count` is still the number of holes (see
+ * `BLOB_COUNT_HOLES`). This flag can not be combined with
+ * `BLOB_EXTRACT_INTERNAL`, `BLOB_NO_LABELS` or `blob_context_t::min_perimeter`,
+ * and is not supported for multi-class images, contour callbacks and
+ * incremental labelling.
+ */
+#define BLOB_TWO_PASS           0x200
+/**
+ * Only store the corners of the contours.
+ * The tracer drops the points in the middle of straight runs (consecutive
+ * steps in the same direction), so only the first point of a contour and
+ * the points where the direction changes are stored. The perimeter is
+ * still the number of contour pixels. This flag can not be combined with
+ * `BLOB_CHAIN_CODES`.
+ */
+#define BLOB_SIMPLIFY           0x400
+/**
+ * Build the contour tree.
+ * Each blob is linked to the blob whose hole contains it (see
+ * `blob_t::parent`, `blob_t::hole`, `blob_t::child` and `blob_t::sibling`).
+ * The background runs are merged with the 4-connected runs of the previous
+ * row during the scan, so each blob gets the background region around it
+ * when its external contour starts, and each hole gets its region when it
+ * is traced. This flag can not be combined with `BLOB_COUNT_HOLES` or
+ * `BLOB_TWO_PASS`, and is not supported for multi-class images, contour
+ * callbacks, incremental labelling and streams. The multi-threaded
+ * labelling falls back to a single thread.
+ */
+#define BLOB_CONTOUR_TREE       0x800
 
 /**
  * Contour.
- * Array of contour pixel coordinates. A coordinate is stored as 2 int16_t.
+ * Array of contour pixel coordinates. A coordinate is stored as 2 blob_coord_t.
  * The 1st one being X and the 2nd Y.
  */
 typedef struct
 {
     /** Number of points. **/
     int count;
-    /** Number of allocated points. **/
+    /** Number of allocated points (0 if the points are stored in a context pool). **/
     int capacity;
     /** Point array. **/
-    int16_t *points;
+    blob_coord_t *points;
+    /** Index of the first point in the context pool (arena mode only). **/
+    size_t offset;
+    /**
+     * Chain codes (`BLOB_CHAIN_CODES` only, NULL if there is only one point).
+     * The `count - 1` steps between 2 consecutive points are packed
+     * as 3 bits codes, least significant bits first. A code is the
+     * index of the direction of the step: 0 for (1,0), then clockwise
+     * (1,1), (0,1), (-1,1), (-1,0), (-1,-1), (0,-1) and 7 for (1,-1).
+     */
+    uint8_t *codes;
+    /** Index of the first code byte in the context code pool. **/
+    size_t code_offset;
 } contour_t;
 
+/**
+ * Blob features.
+ * They are accumulated during the raster scan, one horizontal run of pixels
+ * at a time. Coordinates are expressed in the input image, like contour
+ * points. The centroid is `(sum_x / area, sum_y / area)`.
+ */
+typedef struct
+{
+    /** Number of pixels. **/
+    int64_t area;
+    /** Bounding box upper left corner. **/
+    blob_coord_t min_x, min_y;
+    /** Bounding box lower right corner (inclusive). **/
+    blob_coord_t max_x, max_y;
+    /** Sum of the pixel coordinates (first order moments). **/
+    int64_t sum_x, sum_y;
+    /** Sum of the squared pixel coordinates and of their product (second order moments). **/
+    int64_t sum_xx, sum_yy, sum_xy;
+    /** Number of points of the external contour (always computed). **/
+    int perimeter;
+} blob_features_t;
+
 /**
  * Blob.
  */
@@ -121,8 +440,308 @@ typedef struct
     contour_t *internal;
     /** Number of internal contour (also called euler number). **/
     int internal_count;
+    /** Number of allocated internal contours. **/
+    int internal_capacity;
+    /** Features (only computed if `BLOB_FEATURES` was set, except the perimeter). **/
+    blob_features_t features;
+    /** Coordinates of the first pixel of the blob in raster order (where its external contour starts). **/
+    blob_coord_t x, y;
+    /** Value of the blob pixels with `find_blobs_class_ctx`, 1 otherwise. **/
+    uint8_t cls;
+    /** Index of the blob whose hole contains this blob, or -1 (only computed with `BLOB_CONTOUR_TREE`). **/
+    int parent;
+    /** Index of the hole containing this blob in the holes of the parent blob, or -1. **/
+    int hole;
+    /** Index of the first blob lying in one of the holes of this blob, or -1. **/
+    int child;
+    /** Index of the next blob with the same parent (in the same hole or not), or -1. The blobs without parent are linked from the first one. **/
+    int sibling;
 } blob_t;
 
+/**
+ * Horizontal run of foreground pixels.
+ */
+typedef struct
+{
+    /** X coordinate of the first pixel. **/
+    blob_coord_t x;
+    /** Number of pixels. **/
+    blob_coord_t length;
+} blob_run_t;
+
+/**
+ * Instrumentation counters.
+ * They are only updated if `BLOB_STATS` is defined where the
+ * implementation is included. Times are in nanoseconds.
+ */
+typedef struct
+{
+    /** Number of foreground pixels visited by the raster scan. **/
+    uint64_t pixels;
+    /** Number of external contours traced. **/
+    uint64_t external_contours;
+    /** Number of internal contours traced. **/
+    uint64_t internal_contours;
+    /** Number of steps made by the contour tracer (contour pixels visited). **/
+    uint64_t trace_steps;
+    /** Number of reallocations of the blob array. **/
+    uint64_t blob_reallocs;
+    /** Size in bytes of the blob array reallocations. **/
+    uint64_t blob_bytes;
+    /** Number of reallocations of the contour storage (points, chain codes and internal contour arrays). **/
+    uint64_t contour_reallocs;
+    /** Size in bytes of the contour storage reallocations. **/
+    uint64_t contour_bytes;
+    /** Time spent in the raster scan (callbacks included), contour tracing excluded. **/
+    uint64_t scan_ns;
+    /** Time spent tracing external contours. **/
+    uint64_t external_ns;
+    /** Time spent tracing internal contours. **/
+    uint64_t internal_ns;
+} blob_stats_t;
+
+/**
+ * Rectangle.
+ */
+typedef struct
+{
+    /** Upper left corner. **/
+    blob_coord_t x, y;
+    /** Dimensions. **/
+    blob_coord_t w, h;
+} blob_rect_t;
+
+/** Version of the binary blob set format. **/
+#define BLOB_FILE_VERSION 1
+
+/**
+ * Binary blob set header.
+ * A blob set is stored as this header, followed by the blob table, the
+ * contour table and the point pool. Each part starts on an 8 bytes
+ * boundary, so the tables can be used directly from a memory mapped file.
+ * All values are stored in the byte order of the writer.
+ */
+typedef struct
+{
+    /** "BLOB". **/
+    char magic[4];
+    /** `BLOB_FILE_VERSION`. **/
+    uint16_t version;
+    /** Size of a coordinate in bytes (`sizeof(blob_coord_t)`). **/
+    uint8_t coord_size;
+    /** Unused (0). **/
+    uint8_t reserved;
+    /** Number of blobs. **/
+    uint32_t count;
+    /** Number of contours. **/
+    uint32_t contour_count;
+    /** Number of points. **/
+    uint64_t point_count;
+    /** Size of the blob set in bytes. **/
+    uint64_t size;
+} blob_file_header_t;
+
+/**
+ * Blob record of a binary blob set (see `blob_t`).
+ */
+typedef struct
+{
+    /** Label. **/
+    int32_t label;
+    /** Coordinates of the first pixel of the blob. **/
+    int32_t x, y;
+    /** Pixel value (see `blob_t::cls`). **/
+    int32_t cls;
+    /** Number of holes. **/
+    int32_t internal_count;
+    /** Index of the external contour. The stored internal contours follow it. **/
+    uint32_t contour;
+    /** Number of stored contours (external contour included). **/
+    uint32_t contour_count;
+    /** Number of points of the external contour. **/
+    int32_t perimeter;
+    /** Features (see `blob_features_t`). **/
+    int64_t area;
+    int32_t min_x, min_y, max_x, max_y;
+    int64_t sum_x, sum_y;
+    int64_t sum_xx, sum_yy, sum_xy;
+} blob_file_blob_t;
+
+/**
+ * Contour record of a binary blob set.
+ */
+typedef struct
+{
+    /** Index of the first point in the point pool. **/
+    uint64_t offset;
+    /** Number of points. **/
+    uint32_t count;
+    /** Unused (0). **/
+    uint32_t reserved;
+} blob_file_contour_t;
+
+/**
+ * Binary blob set opened by `blob_file_open`.
+ * The pointers reference the buffer holding the blob set. The points of
+ * contour `c` are the `2 * c->count` coordinates starting at
+ * `points + (2 * c->offset)`.
+ */
+typedef struct
+{
+    /** Header. **/
+    const blob_file_header_t *header;
+    /** Blob table (`header->count` records). **/
+    const blob_file_blob_t *blobs;
+    /** Contour table (`header->contour_count` records). **/
+    const blob_file_contour_t *contours;
+    /** Point pool (`2 * header->point_count` coordinates). **/
+    const blob_coord_t *points;
+} blob_file_t;
+
+/**
+ * Blob extraction context.
+ * Holds the label buffer, the blob array and the contour points so that
+ * they can be reused when calling `find_blobs_ctx` repeatedly.
+ */
+typedef struct blob_context_t
+{
+    /** Label buffer. **/
+    label_t *label;
+    /** Width of the label buffer. **/
+    blob_coord_t label_w;
+    /** Height of the label buffer. **/
+    blob_coord_t label_h;
+    /** Number of allocated labels. **/
+    size_t label_capacity;
+    /** Extracted blobs. **/
+    blob_t *blobs;
+    /** Number of extracted blobs. **/
+    int count;
+    /** Number of allocated blobs. **/
+    int capacity;
+    /** Store contour points in the point pool if set to 1 (default). **/
+    int arena;
+    /** Discard the blobs whose external contour has fewer points (0 by default). **/
+    int min_perimeter;
+    /** Discard the blobs with fewer pixels (0 by default). **/
+    int64_t min_area;
+    /** Point pool. **/
+    blob_coord_t *points;
+    /** Number of points stored in the pool. **/
+    size_t point_count;
+    /** Number of allocated points in the pool. **/
+    size_t point_capacity;
+    /** Chain code pool. **/
+    uint8_t *codes;
+    /** Number of bytes used in the chain code pool. **/
+    size_t code_count;
+    /** Size of the chain code pool in bytes. **/
+    size_t code_capacity;
+    /** Bitmap used to expand run-length encoded images. **/
+    uint8_t *bits;
+    /** Size of the bitmap in bytes. **/
+    size_t bits_capacity;
+    /** Temporary buffer used by the multi-threaded labelling. **/
+    void *scratch;
+    /** Size of the temporary buffer in bytes. **/
+    size_t scratch_capacity;
+    /** Background regions used to build the contour tree. **/
+    void *regions;
+    /** Size of the region buffer in bytes. **/
+    size_t region_capacity;
+    /** Per strip contexts used by the multi-threaded labelling. **/
+    struct blob_context_t *workers;
+    /** Number of allocated per strip contexts. **/
+    int worker_count;
+    /** Counters of the last call (see `BLOB_STATS`). **/
+    blob_stats_t stats;
+    /** ROI upper left corner of the last call to `find_blobs_update_ctx`. **/
+    blob_coord_t update_x, update_y;
+    /** Flags of the last call to `find_blobs_update_ctx`, or 0 if the results can not be updated. **/
+    int update_flags;
+} blob_context_t;
+
+/**
+ * Batch job.
+ * The input and ROI are set by the caller. The other fields are set by
+ * `find_blobs_batch_ctx`.
+ */
+typedef struct
+{
+    /** Input image buffer. **/
+    uint8_t *in;
+    /** Width of the input image. **/
+    blob_coord_t in_w;
+    /** Height of the input image. **/
+    blob_coord_t in_h;
+    /** ROI upper left corner. **/
+    blob_coord_t roi_x, roi_y;
+    /** ROI dimensions. **/
+    blob_coord_t roi_w, roi_h;
+    /** Extracted blobs (owned by the context). **/
+    blob_t *blobs;
+    /** Number of extracted blobs. **/
+    int count;
+    /** 1 upon success or 0 if an error occured. **/
+    int status;
+} blob_job_t;
+
+/**
+ * Function called for each contour found by `find_blobs_cb`.
+ * @param [in] blob     Blob the contour belongs to. Its features and
+ *                      number of holes are not final yet.
+ * @param [in] contour  Contour. Its points are only valid during the call.
+ * @param [in] internal 0 for the external contour or 1 for a hole.
+ * @param [in] user     User data given to `find_blobs_cb`.
+ * @return 1 to continue or 0 to stop the labelling.
+ */
+typedef int (*blob_contour_callback_t)(const blob_t *blob, const contour_t *contour, int internal, void *user);
+
+/**
+ * Function called for each blob found by a stream.
+ * The blob and its contours are only valid during the call.
+ * @param [in] blob Blob.
+ * @param [in] user User data given to `blob_stream_begin`.
+ */
+typedef void (*blob_stream_callback_t)(const blob_t *blob, void *user);
+
+/**
+ * Row by row labelling.
+ * The rows of an image are pushed as they arrive and each blob is reported
+ * as soon as the row below it does not touch it anymore. Only the runs of
+ * the blobs not closed yet are kept, instead of a label buffer for the
+ * whole image.
+ */
+typedef struct
+{
+    /** Workspace used to trace the contours of closed blobs. **/
+    blob_context_t ctx;
+    /** Width of the image. **/
+    blob_coord_t width;
+    /** Number of rows pushed so far. **/
+    blob_coord_t y;
+    /** Flags given to `blob_stream_begin`. **/
+    int flags;
+    /** Blob callback. **/
+    blob_stream_callback_t callback;
+    /** User data passed to the callback. **/
+    void *user;
+    /** Label of the last reported blob. **/
+    label_t label;
+    /** Foreground runs of the previous and current rows. **/
+    struct blob_stream_run_t *runs[2];
+    /** Number of runs of the previous and current rows. **/
+    int run_count[2];
+    /** Number of allocated runs per row. **/
+    int run_capacity;
+    /** Blobs not closed yet. **/
+    struct blob_stream_blob_t *open;
+    /** Number of used and allocated blob slots. **/
+    int open_count, open_capacity;
+    /** First free blob slot and first slot released by the current row. **/
+    int free_slot, pending_slot;
+} blob_stream_t;
+
 /**
  * Compute connected components labels and contours.
  * @param [in]  roi_x   X coordinate of the upper left corner of the ROI.
@@ -140,11 +759,20 @@ typedef struct
  * @param [in]  extract_internal  Store internal contours in blob if set to 1.
  * @return 1 upon success or 0 if an error occured.
  */
-int find_blobs(int16_t roi_x, int16_t roi_y, int16_t roi_w, int16_t roi_h,
-               uint8_t *in, int16_t in_w, int16_t in_h, 
-               label_t **label, int16_t *label_w, int16_t *label_h, 
+int find_blobs(blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+               uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, 
+               label_t **label, blob_coord_t *label_w, blob_coord_t *label_h, 
                blob_t** blobs, int *count, int extract_internal);
 
+/**
+ * Get the counters of the last call to `find_blobs` (see `BLOB_STATS`).
+ * Without `BLOB_STATS`, the counters are all 0. Otherwise they are kept
+ * in a global, so this function and `find_blobs` are not thread safe;
+ * `find_blobs_ctx` gives the counters of each context instead.
+ * @param [out] stats Counters.
+ */
+void find_blobs_stats(blob_stats_t *stats);
+
 /**
  * Destroy all blobs created by find_blobs.
  * @param [in] blobs Pointer to the array of blobs.
@@ -152,6 +780,449 @@ int find_blobs(int16_t roi_x, int16_t roi_y, int16_t roi_w, int16_t roi_h,
  */
 void destroy_blobs(blob_t *blobs, int count);
 
+/**
+ * Get the points of a contour.
+ * The chain codes of a contour stored with `BLOB_CHAIN_CODES` are decoded.
+ * The points of other contours are copied.
+ * @param [in]  contour Contour.
+ * @param [out] points  Array of `2 * contour->count` coordinates.
+ */
+void contour_decode(const contour_t *contour, blob_coord_t *points);
+
+/**
+ * Get the size of the binary blob set holding some blobs.
+ * @param [in] blobs Blobs.
+ * @param [in] count Number of blobs.
+ * @param [in] flags Flags used to extract the blobs. The internal contours
+ *                   are only stored if `BLOB_EXTRACT_INTERNAL` is set.
+ * @return Size in bytes.
+ */
+size_t blob_file_size(const blob_t *blobs, int count, int flags);
+
+/**
+ * Store blobs as a binary blob set.
+ * The whole set is written in the buffer, so it can be saved with a single
+ * `fwrite`. Chain codes are decoded into points.
+ * @param [in]  blobs  Blobs.
+ * @param [in]  count  Number of blobs.
+ * @param [in]  flags  Flags used to extract the blobs (see `blob_file_size`).
+ * @param [out] buffer Output buffer, aligned on 8 bytes.
+ * @param [in]  size   Size of the output buffer in bytes.
+ * @return Number of bytes written, or 0 if an error occured.
+ */
+size_t blob_file_write(const blob_t *blobs, int count, int flags, void *buffer, size_t size);
+
+/**
+ * Open a binary blob set without copying it.
+ * The header and the contour offsets are checked against the size of the
+ * buffer, which must stay valid as long as the blob set is used.
+ * @param [out] file Blob set.
+ * @param [in]  data Buffer holding the blob set (for example a memory
+ *                   mapped file), aligned on 8 bytes.
+ * @param [in]  size Size of the buffer in bytes.
+ * @return 1 upon success or 0 if the buffer does not hold a valid blob set.
+ */
+int blob_file_open(blob_file_t *file, const void *data, size_t size);
+
+/**
+ * Initialize an empty context.
+ * @param [out] ctx Context.
+ */
+void blob_context_init(blob_context_t *ctx);
+
+/**
+ * Discard the blobs and labels stored in a context.
+ * The allocated memory is kept for later use.
+ * @param [in out] ctx Context.
+ */
+void blob_context_reset(blob_context_t *ctx);
+
+/**
+ * Preallocate blobs and contour points.
+ * The blob array and the point pool grow geometrically when needed. This
+ * function can be used to size them up front when the number of blobs and
+ * contour points is roughly known, so that no reallocation happens during
+ * `find_blobs_ctx`.
+ * @param [in out] ctx    Context.
+ * @param [in]     blobs  Number of blobs.
+ * @param [in]     points Number of contour points (arena mode only).
+ * @return 1 upon success or 0 if an error occured.
+ */
+int blob_context_reserve(blob_context_t *ctx, int blobs, size_t points);
+
+/**
+ * Release all the memory held by a context.
+ * @param [in out] ctx Context.
+ */
+void blob_context_destroy(blob_context_t *ctx);
+
+/**
+ * Compute connected components labels and contours using the buffers
+ * of a context.
+ * The results of any previous call are discarded. The label buffer and
+ * the blobs are stored in `ctx->label` and `ctx->blobs`.
+ * @param [in out] ctx  Context.
+ * @param [in]  roi_x   X coordinate of the upper left corner of the ROI.
+ * @param [in]  roi_y   Y coordinate of the upper left corner of the ROI
+ * @param [in]  roi_w   Width of the ROI.
+ * @param [in]  roi_h   Height of the ROI.
+ * @param [in]  in      Pointer to the input image buffer.
+ * @param [in]  in_w    Width of the input image.
+ * @param [in]  in_h    Height of the input image.
+ * @param [in]  flags   Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                      `BLOB_NO_EXTERNAL_POINTS`, `BLOB_NO_LABELS`,
+ *                      `BLOB_FEATURES`, `BLOB_SECOND_ORDER`,
+ *                      `BLOB_CHAIN_CODES`, `BLOB_ERASE_FILTERED`,
+ *                      `BLOB_COUNT_HOLES`, `BLOB_TWO_PASS`, `BLOB_SIMPLIFY`
+ *                      and `BLOB_CONTOUR_TREE`.
+ * @return 1 upon success or 0 if an error occured.
+ */
+int find_blobs_ctx(blob_context_t *ctx,
+                   blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                   uint8_t *in, blob_coord_t in_w, blob_coord_t in_h,
+                   int flags);
+
+/**
+ * Compute connected components labels and contours of a 1 bit per pixel
+ * image using the buffers of a context.
+ * Pixels are packed 8 per byte, the leftmost pixel being stored in the most
+ * significant bit. Bits set to 1 are part of the foreground.
+ * @param [in out] ctx  Context.
+ * @param [in]  roi_x     X coordinate of the upper left corner of the ROI.
+ * @param [in]  roi_y     Y coordinate of the upper left corner of the ROI
+ * @param [in]  roi_w     Width of the ROI.
+ * @param [in]  roi_h     Height of the ROI.
+ * @param [in]  in        Pointer to the input image buffer.
+ * @param [in]  in_w      Width of the input image in pixels.
+ * @param [in]  in_h      Height of the input image.
+ * @param [in]  in_stride Number of bytes between 2 rows, or 0 if rows are
+ *                        not padded (`(in_w + 7) / 8` bytes).
+ * @param [in]  flags   Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                      `BLOB_NO_EXTERNAL_POINTS`, `BLOB_NO_LABELS`,
+ *                      `BLOB_FEATURES`, `BLOB_SECOND_ORDER`,
+ *                      `BLOB_CHAIN_CODES`, `BLOB_ERASE_FILTERED`,
+ *                      `BLOB_COUNT_HOLES`, `BLOB_TWO_PASS`, `BLOB_SIMPLIFY`
+ *                      and `BLOB_CONTOUR_TREE`.
+ * @return 1 upon success or 0 if an error occured.
+ */
+int find_blobs_1bpp_ctx(blob_context_t *ctx,
+                        blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                        const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, int in_stride,
+                        int flags);
+
+/**
+ * Compute connected components labels and contours of a run-length encoded
+ * image using the buffers of a context.
+ * The foreground pixels of row `y` are given by the runs stored from
+ * `runs[rows[y]]` up to `runs[rows[y+1]-1]`. Runs of a row must not
+ * overlap. The runs overlapping the ROI are expanded into a 1bpp bitmap
+ * kept in the context. 
+ * @param [in out] ctx  Context.
+ * @param [in]  roi_x   X coordinate of the upper left corner of the ROI.
+ * @param [in]  roi_y   Y coordinate of the upper left corner of the ROI
+ * @param [in]  roi_w   Width of the ROI.
+ * @param [in]  roi_h   Height of the ROI.
+ * @param [in]  runs    Foreground runs.
+ * @param [in]  rows    Index of the first run of each row (`in_h+1` entries).
+ * @param [in]  in_w    Width of the input image.
+ * @param [in]  in_h    Height of the input image.
+ * @param [in]  flags   Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                      `BLOB_NO_EXTERNAL_POINTS`, `BLOB_NO_LABELS`,
+ *                      `BLOB_FEATURES`, `BLOB_SECOND_ORDER`,
+ *                      `BLOB_CHAIN_CODES`, `BLOB_ERASE_FILTERED`,
+ *                      `BLOB_COUNT_HOLES`, `BLOB_TWO_PASS`, `BLOB_SIMPLIFY`
+ *                      and `BLOB_CONTOUR_TREE`.
+ * @return 1 upon success or 0 if an error occured.
+ */
+int find_blobs_rle_ctx(blob_context_t *ctx,
+                       blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                       const blob_run_t *runs, const int *rows, blob_coord_t in_w, blob_coord_t in_h,
+                       int flags);
+
+/**
+ * Compute connected components labels and contours of an image whose rows
+ * may be padded, optionally writing the labels into a caller owned buffer.
+ * The label buffer may be a sub-rectangle of a larger one. It must hold
+ * the labels of the ROI once clamped to the image dimensions, `label`
+ * being the label of its upper left pixel. Only those labels are cleared
+ * and written, and `ctx->label` is left untouched (`ctx->label_w` and
+ * `ctx->label_h` are 0). If `label` is NULL, the labels are stored in the
+ * context like with `find_blobs_ctx`.
+ * If `BLOB_PADDED` is set, the neighbours of the pixels being traced are
+ * read and marked without bounds checks, which is faster when there are
+ * many contour pixels.
+ * @param [in out] ctx  Context.
+ * @param [in]  roi_x        X coordinate of the upper left corner of the ROI.
+ * @param [in]  roi_y        Y coordinate of the upper left corner of the ROI
+ * @param [in]  roi_w        Width of the ROI.
+ * @param [in]  roi_h        Height of the ROI.
+ * @param [in]  in           Pointer to the input image buffer.
+ * @param [in]  in_w         Width of the input image.
+ * @param [in]  in_h         Height of the input image.
+ * @param [in]  in_stride    Number of bytes between 2 rows, or 0 if rows
+ *                           are not padded.
+ * @param [out] label        Caller owned label buffer or NULL.
+ * @param [in]  label_stride Number of labels between 2 rows of `label`.
+ * @param [in]  flags        Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                           `BLOB_NO_EXTERNAL_POINTS`, `BLOB_NO_LABELS`,
+ *                           `BLOB_FEATURES`, `BLOB_SECOND_ORDER`,
+ *                           `BLOB_CHAIN_CODES`, `BLOB_ERASE_FILTERED`,
+ *                           `BLOB_COUNT_HOLES`, `BLOB_PADDED`,
+ *                           `BLOB_TWO_PASS`, `BLOB_SIMPLIFY` and
+ *                           `BLOB_CONTOUR_TREE`.
+ * @return 1 upon success or 0 if an error occured.
+ */
+int find_blobs_stride_ctx(blob_context_t *ctx,
+                          blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                          const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, int in_stride,
+                          label_t *label, int label_stride, int flags);
+
+/**
+ * Compute connected components labels and contours of a grayscale image
+ * thresholded on the fly, using the buffers of a context.
+ * A pixel belongs to the foreground if its value is in [lo, hi], so the
+ * usual `v >= threshold` test is the range [threshold, 255]. The input is
+ * read only, and no thresholded copy of the image is made.
+ * @param [in out] ctx  Context.
+ * @param [in]  roi_x     X coordinate of the upper left corner of the ROI.
+ * @param [in]  roi_y     Y coordinate of the upper left corner of the ROI
+ * @param [in]  roi_w     Width of the ROI.
+ * @param [in]  roi_h     Height of the ROI.
+ * @param [in]  in        Pointer to the grayscale image buffer.
+ * @param [in]  in_w      Width of the input image.
+ * @param [in]  in_h      Height of the input image.
+ * @param [in]  in_stride Number of bytes between 2 rows, or 0 if rows are
+ *                        not padded.
+ * @param [in]  lo        Lowest foreground value.
+ * @param [in]  hi        Highest foreground value.
+ * @param [in]  flags     Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                        `BLOB_NO_EXTERNAL_POINTS`, `BLOB_NO_LABELS`,
+ *                        `BLOB_FEATURES`, `BLOB_SECOND_ORDER`,
+ *                        `BLOB_CHAIN_CODES`, `BLOB_ERASE_FILTERED`,
+ *                        `BLOB_COUNT_HOLES`, `BLOB_TWO_PASS`,
+ *                        `BLOB_SIMPLIFY` and `BLOB_CONTOUR_TREE`.
+ * @return 1 upon success or 0 if an error occured.
+ */
+int find_blobs_range_ctx(blob_context_t *ctx,
+                         blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                         const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, int in_stride,
+                         uint8_t lo, uint8_t hi, int flags);
+
+/**
+ * Compute connected components labels and contours of a multi-class image
+ * using the buffers of a context.
+ * Adjacent pixels are connected if they have the same non-zero value, so a
+ * single pass yields the components of every class. The class of a blob
+ * is stored in `blob_t::cls`. The blobs of all classes are sorted in raster
+ * order of their first pixel and have distinct labels. The background
+ * pixels visited by the tracer are not marked with -1 in the label buffer
+ * as they may belong to another class.
+ * @param [in out] ctx  Context.
+ * @param [in]  roi_x     X coordinate of the upper left corner of the ROI.
+ * @param [in]  roi_y     Y coordinate of the upper left corner of the ROI
+ * @param [in]  roi_w     Width of the ROI.
+ * @param [in]  roi_h     Height of the ROI.
+ * @param [in]  in        Pointer to the class image buffer.
+ * @param [in]  in_w      Width of the input image.
+ * @param [in]  in_h      Height of the input image.
+ * @param [in]  in_stride Number of bytes between 2 rows, or 0 if rows are
+ *                        not padded.
+ * @param [in]  flags     Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                        `BLOB_NO_EXTERNAL_POINTS`, `BLOB_NO_LABELS`,
+ *                        `BLOB_FEATURES`, `BLOB_SECOND_ORDER`,
+ *                        `BLOB_CHAIN_CODES`, `BLOB_ERASE_FILTERED` and
+ *                        `BLOB_SIMPLIFY`.
+ * @return 1 upon success or 0 if an error occured.
+ */
+int find_blobs_class_ctx(blob_context_t *ctx,
+                         blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                         const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, int in_stride,
+                         int flags);
+
+/**
+ * Compute connected components labels and pass each contour to a callback.
+ * The points of a contour are only stored during the callback, so only the
+ * largest contour is kept in memory. The blobs (without their contour
+ * points) and the label buffer are stored in the context like with
+ * `find_blobs_ctx`. The callback is called for each external contour when
+ * a new blob is found, with no points if `BLOB_NO_EXTERNAL_POINTS` is set,
+ * and for each hole, with no points unless `BLOB_EXTRACT_INTERNAL` is set.
+ * @param [in out] ctx  Context.
+ * @param [in]  roi_x    X coordinate of the upper left corner of the ROI.
+ * @param [in]  roi_y    Y coordinate of the upper left corner of the ROI
+ * @param [in]  roi_w    Width of the ROI.
+ * @param [in]  roi_h    Height of the ROI.
+ * @param [in]  in       Pointer to the input image buffer.
+ * @param [in]  in_w     Width of the input image.
+ * @param [in]  in_h     Height of the input image.
+ * @param [in]  flags    Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                       `BLOB_NO_EXTERNAL_POINTS`, `BLOB_NO_LABELS`,
+ *                       `BLOB_FEATURES`, `BLOB_SECOND_ORDER`,
+ *                       `BLOB_CHAIN_CODES`, `BLOB_ERASE_FILTERED`,
+ *                       `BLOB_COUNT_HOLES` and `BLOB_SIMPLIFY`.
+ * @param [in]  callback Contour callback.
+ * @param [in]  user     User data passed to the callback.
+ * @return 1 upon success or 0 if an error occured or if the callback
+ *         returned 0.
+ */
+int find_blobs_cb(blob_context_t *ctx,
+                  blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                  uint8_t *in, blob_coord_t in_w, blob_coord_t in_h,
+                  int flags, blob_contour_callback_t callback, void *user);
+
+/**
+ * Compute connected components labels and contours on several threads
+ * using the buffers of a context.
+ * The ROI is split into horizontal strips which are labelled concurrently.
+ * The blobs touching the boundary between 2 strips are then merged and
+ * traced again over the rows they span, so that the blobs (their order,
+ * contours and features) and the labels of their pixels are the same as
+ * the ones computed by `find_blobs_ctx`. Only the background pixels marked
+ * with -1 near those boundaries may differ.
+ * The blobs spanning a boundary are traced again by a single thread, so
+ * images whose large blobs span several strips are not sped up. The rows
+ * of those blobs are found beforehand by merging the runs of each strip
+ * on its own thread. When they cover at least half of the ROI, the ROI is
+ * labelled by a single thread like with `find_blobs_ctx`, without tracing
+ * the strips.
+ * Threads are only created if `BLOB_THREADS` is defined where the
+ * implementation is included. Otherwise the strips are processed one after
+ * the other.
+ * @param [in out] ctx  Context.
+ * @param [in]  roi_x   X coordinate of the upper left corner of the ROI.
+ * @param [in]  roi_y   Y coordinate of the upper left corner of the ROI
+ * @param [in]  roi_w   Width of the ROI.
+ * @param [in]  roi_h   Height of the ROI.
+ * @param [in]  in      Pointer to the input image buffer.
+ * @param [in]  in_w    Width of the input image.
+ * @param [in]  in_h    Height of the input image.
+ * @param [in]  flags   Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                      `BLOB_NO_EXTERNAL_POINTS`, `BLOB_NO_LABELS`,
+ *                      `BLOB_FEATURES`, `BLOB_SECOND_ORDER`,
+ *                      `BLOB_CHAIN_CODES`, `BLOB_ERASE_FILTERED`,
+ *                      `BLOB_COUNT_HOLES`, `BLOB_TWO_PASS`, `BLOB_SIMPLIFY`
+ *                      and `BLOB_CONTOUR_TREE`.
+ * @param [in]  threads Number of strips. Strips are at least
+ *                      `BLOB_MIN_STRIP_ROWS` rows high.
+ * @return 1 upon success or 0 if an error occured.
+ */
+int find_blobs_mt_ctx(blob_context_t *ctx,
+                      blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                      uint8_t *in, blob_coord_t in_w, blob_coord_t in_h,
+                      int flags, int threads);
+
+/**
+ * Compute connected components and contours of many images on several
+ * threads.
+ * The jobs are distributed across `threads` threads, each one with its own
+ * reusable workspace kept in the context. The blobs of each job are stored
+ * in the context and are valid until the next call using it. No label
+ * buffer is returned.
+ * Threads are only created if `BLOB_THREADS` is defined where the
+ * implementation is included.
+ * @param [in out] ctx     Context.
+ * @param [in out] jobs    Jobs.
+ * @param [in]     count   Number of jobs.
+ * @param [in]     flags   Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                         `BLOB_NO_EXTERNAL_POINTS`, `BLOB_NO_LABELS`,
+ *                         `BLOB_FEATURES`, `BLOB_SECOND_ORDER`,
+ *                         `BLOB_CHAIN_CODES`, `BLOB_ERASE_FILTERED`,
+ *                         `BLOB_COUNT_HOLES`, `BLOB_TWO_PASS`,
+ *                         `BLOB_SIMPLIFY` and `BLOB_CONTOUR_TREE`.
+ * @param [in]     threads Number of threads.
+ * @return 1 if all the jobs succeeded or 0 if an error occured.
+ */
+int find_blobs_batch_ctx(blob_context_t *ctx, blob_job_t *jobs, int count, int flags, int threads);
+
+/**
+ * Update the results of the previous frame of a video after some areas
+ * of the image changed.
+ * Only the blobs touching a dirty rectangle are labelled again, so the
+ * cost of a call depends on the number and the size of the changed areas
+ * and of the blobs around them. If `ctx` does not hold the results of a
+ * previous call with the same ROI and flags, or if `dirty` is NULL, the
+ * whole ROI is labelled.
+ * The other blobs keep their label, contours and features, and are still
+ * stored before the new ones. Their order and their labels are no longer
+ * those of `find_blobs_ctx` (`ctx->blobs[i].label` may not be `i+1`). The
+ * new blobs get labels which are not used by the previous frame. Only the
+ * foreground pixels are guaranteed to be labelled as with
+ * `find_blobs_ctx`.
+ * `BLOB_FEATURES` is always set, and `ctx->min_area` and
+ * `ctx->min_perimeter` must be 0.
+ * @param [in out] ctx         Context.
+ * @param [in]     roi_x       X coordinate of the upper left corner of the ROI.
+ * @param [in]     roi_y       Y coordinate of the upper left corner of the ROI
+ * @param [in]     roi_w       Width of the ROI.
+ * @param [in]     roi_h       Height of the ROI.
+ * @param [in]     in          Pointer to the input image buffer.
+ * @param [in]     in_w        Width of the input image.
+ * @param [in]     in_h        Height of the input image.
+ * @param [in]     dirty       Rectangles (in image coordinates) covering all
+ *                             the pixels which changed since the previous
+ *                             call, or NULL.
+ * @param [in]     dirty_count Number of rectangles.
+ * @param [in]     flags       Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                             `BLOB_NO_EXTERNAL_POINTS`,
+ *                             `BLOB_SECOND_ORDER`, `BLOB_CHAIN_CODES`,
+ *                             `BLOB_COUNT_HOLES` and `BLOB_SIMPLIFY`.
+ * @return 1 upon success or 0 if an error occured. After an error, the
+ *         next call labels the whole ROI.
+ */
+int find_blobs_update_ctx(blob_context_t *ctx,
+                          blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                          const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h,
+                          const blob_rect_t *dirty, int dirty_count, int flags);
+
+/**
+ * Initialize an empty stream.
+ * @param [out] stream Stream.
+ */
+void blob_stream_init(blob_stream_t *stream);
+
+/**
+ * Start labelling a new image.
+ * Blobs are reported in the order they are closed, and are labelled in the
+ * same order starting from 1. Their contours, holes and features are the
+ * same as the ones found by `find_blobs_ctx` on the whole image.
+ * @param [in out] stream   Stream.
+ * @param [in]     width    Width of the image.
+ * @param [in]     flags    Combination of `BLOB_EXTRACT_INTERNAL`,
+ *                          `BLOB_NO_EXTERNAL_POINTS`, `BLOB_FEATURES`,
+ *                          `BLOB_SECOND_ORDER`, `BLOB_CHAIN_CODES`,
+ *                          `BLOB_COUNT_HOLES`, `BLOB_TWO_PASS` and
+ *                          `BLOB_SIMPLIFY`.
+ * @param [in]     callback Function called for each blob.
+ * @param [in]     user     User data passed to the callback.
+ * @return 1 upon success or 0 if an error occured.
+ */
+int blob_stream_begin(blob_stream_t *stream, blob_coord_t width, int flags, blob_stream_callback_t callback, void *user);
+
+/**
+ * Label the next rows of the image.
+ * The image can not be taller than `BLOB_COORD_MAX - 1` rows.
+ * @param [in out] stream Stream.
+ * @param [in]     rows   Pointer to the first row (8bpp, 0 is background).
+ * @param [in]     count  Number of rows.
+ * @param [in]     stride Number of bytes between 2 rows.
+ * @return 1 upon success or 0 if an error occured or if the rows do not
+ *         fit in the coordinate range.
+ */
+int blob_stream_push_rows(blob_stream_t *stream, const uint8_t *rows, int count, ptrdiff_t stride);
+
+/**
+ * Report the blobs still open at the end of the image.
+ * @param [in out] stream Stream.
+ * @return 1 upon success or 0 if an error occured.
+ */
+int blob_stream_finish(blob_stream_t *stream);
+
+/**
+ * Release all the memory held by a stream.
+ * @param [in out] stream Stream.
+ */
+void blob_stream_destroy(blob_stream_t *stream);
+
 #ifdef __cplusplus
 }
 #endif
@@ -192,180 +1263,4259 @@ void destroy_blobs(blob_t *blobs, int count);
 #define BLOB_ERROR(format, ...) fprintf(stderr, format, ##__VA_ARGS__)
 #endif
 
-/* Add a point to contour */
-static int contour_add_point(contour_t *contour, int16_t x, int16_t y)
-{
-    long int offset = contour->count * 2;
-    if(contour->count == contour->capacity)
-    {
-        int newCapacity = contour->capacity ? (contour->capacity * 2) : 32;
-        int16_t *tmp = (int16_t*)BLOB_REALLOC(contour->points, newCapacity * (2 * sizeof(int16_t)));
-        if(NULL == tmp)
-        {
-            BLOB_ERROR("Out of memory");
-            return 0;
-        }
-        contour->points = tmp;
-        contour->capacity = newCapacity;
-    }
-    
-    contour->points[offset  ] = x;
-    contour->points[offset+1] = y;
-    
-    contour->count++;
-    return 1;
-}
+#if defined(_MSC_VER)
+#define BLOB_INLINE __forceinline
+#elif defined(__GNUC__)
+#define BLOB_INLINE inline __attribute__((always_inline))
+#else
+#define BLOB_INLINE inline
+#endif
+
+#if !defined(BLOB_NO_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BLOB_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define BLOB_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define BLOB_SIMD_NEON
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static BLOB_INLINE int blob_ctz32(uint32_t v) { unsigned long i; _BitScanForward(&i, v); return (int)i; }
+#if defined(_M_X64) || defined(_M_ARM64)
+static BLOB_INLINE int blob_ctz64(uint64_t v) { unsigned long i; _BitScanForward64(&i, v); return (int)i; }
+#endif
+#else
+static BLOB_INLINE int blob_ctz32(uint32_t v) { return __builtin_ctz(v); }
+static BLOB_INLINE int blob_ctz64(uint64_t v) { return __builtin_ctzll(v); }
+#endif
+
+#if defined(BLOB_THREADS)
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#endif
 
-/* Add a new blob */
-static int blob_add(blob_t **b, int *count)
+#if defined(BLOB_STATS)
+#if !defined(BLOB_STATS_NOW)
+#if defined(_WIN32)
+#include <windows.h>
+static uint64_t blob_stats_now(void)
 {
-    blob_t *tmp = (blob_t*)BLOB_REALLOC(*b, (*count+1) * sizeof(blob_t));
-    if(NULL == tmp)
-    {
-        BLOB_ERROR("Out of memory");
-        return 0;
-    }
-    BLOB_MEMSET(&tmp[*count], 0, sizeof(blob_t));
-    *b = tmp;
-    *count += 1;
-    return 1;
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return ((uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000u)
+         + (((uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000u) / (uint64_t)frequency.QuadPart);
 }
+#else
+#include <time.h>
+static uint64_t blob_stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+}
+#endif
+#define BLOB_STATS_NOW() blob_stats_now()
+#endif
+#define BLOB_STATS_ADD(ctx, field, n) ((ctx)->stats.field += (uint64_t)(n))
+#define BLOB_STATS_TIME(t) ((t) = BLOB_STATS_NOW())
+/* Add the time elapsed since t to a counter and to total. */
+#define BLOB_STATS_ELAPSED(ctx, field, t, total) do { const uint64_t blob_elapsed_ = BLOB_STATS_NOW() - (t); (ctx)->stats.field += blob_elapsed_; (total) += blob_elapsed_; } while(0)
+#else
+#define BLOB_STATS_ADD(ctx, field, n) ((void)0)
+#define BLOB_STATS_TIME(t) ((void)(t))
+#define BLOB_STATS_ELAPSED(ctx, field, t, total) ((void)(total))
+#endif
+
+#if defined(BLOB_STATS)
+/* Counters of the last call to find_blobs. Only compiled with BLOB_STATS,
+   so that find_blobs does not write a global otherwise. */
+static blob_stats_t blob_find_blobs_stats;
+#endif
+
+/* Add the counters of src to dst and clear them. */
+static void blob_stats_move(blob_stats_t *dst, blob_stats_t *src)
+{
+    /* All the counters are uint64_t. */
+    uint64_t *d = (uint64_t*)dst;
+    const uint64_t *s = (const uint64_t*)src;
+    size_t i;
+    for(i=0; i<(sizeof(blob_stats_t) / sizeof(uint64_t)); i++)
+    {
+        d[i] += s[i];
+    }
+    BLOB_MEMSET(src, 0, sizeof(blob_stats_t));
+}
+
+/* Task run by blob_parallel_run. */
+typedef void (*blob_task_t)(void *arg, int index);
+
+typedef struct
+{
+    blob_task_t task;
+    void *arg;
+    int index;
+    int started;
+} blob_task_slot_t;
+
+#if defined(BLOB_THREADS)
+#if defined(_WIN32)
+typedef HANDLE blob_thread_t;
+
+static DWORD WINAPI blob_thread_main(LPVOID param)
+{
+    blob_task_slot_t *slot = (blob_task_slot_t*)param;
+    slot->task(slot->arg, slot->index);
+    return 0;
+}
+
+static int blob_thread_create(blob_thread_t *thread, blob_task_slot_t *slot)
+{
+    *thread = CreateThread(NULL, 0, blob_thread_main, slot, 0, NULL);
+    return NULL != *thread;
+}
+
+static void blob_thread_join(blob_thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+#else
+typedef pthread_t blob_thread_t;
+
+static void* blob_thread_main(void *param)
+{
+    blob_task_slot_t *slot = (blob_task_slot_t*)param;
+    slot->task(slot->arg, slot->index);
+    return NULL;
+}
+
+static int blob_thread_create(blob_thread_t *thread, blob_task_slot_t *slot)
+{
+    return 0 == pthread_create(thread, NULL, blob_thread_main, slot);
+}
+
+static void blob_thread_join(blob_thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+#endif
+#endif
+
+/* Run task(arg, 0) ... task(arg, n-1). 
+   Each task gets its own thread if BLOB_THREADS is defined, the first one
+   running on the calling thread. The tasks are run one after the other if
+   the threads can not be created. */
+static void blob_parallel_run(blob_task_t task, void *arg, int n)
+{
+    int k;
+#if defined(BLOB_THREADS)
+    if(n > 1)
+    {
+        blob_thread_t *threads = (blob_thread_t*)BLOB_MALLOC(n * sizeof(blob_thread_t));
+        blob_task_slot_t *slots = (blob_task_slot_t*)BLOB_MALLOC(n * sizeof(blob_task_slot_t));
+        if((NULL != threads) && (NULL != slots))
+        {
+            for(k=1; k<n; k++)
+            {
+                slots[k].task  = task;
+                slots[k].arg   = arg;
+                slots[k].index = k;
+                slots[k].started = blob_thread_create(&threads[k], &slots[k]);
+            }
+            task(arg, 0);
+            for(k=1; k<n; k++)
+            {
+                if(slots[k].started)
+                {
+                    blob_thread_join(threads[k]);
+                }
+                else
+                {
+                    task(arg, k);
+                }
+            }
+            BLOB_FREE(threads);
+            BLOB_FREE(slots);
+            return;
+        }
+        if(NULL != threads) { BLOB_FREE(threads); }
+        if(NULL != slots)   { BLOB_FREE(slots); }
+    }
+#endif
+    for(k=0; k<n; k++)
+    {
+        task(arg, k);
+    }
+}
+
+/* Increment a counter shared by the tasks of blob_parallel_run and return
+   its previous value. */
+static int blob_fetch_add(volatile long *value)
+{
+#if defined(BLOB_THREADS) && defined(_WIN32)
+    return (int)InterlockedExchangeAdd(value, 1);
+#elif defined(BLOB_THREADS)
+    return (int)__atomic_fetch_add(value, 1, __ATOMIC_RELAXED);
+#else
+    long v = *value;
+    *value = v + 1;
+    return (int)v;
+#endif
+}
+
+/* Grow the blob array. */
+static int blob_reserve(blob_context_t *ctx, int capacity)
+{
+    blob_t *tmp;
+    if(capacity <= ctx->capacity)
+    {
+        return 1;
+    }
+    tmp = (blob_t*)BLOB_REALLOC(ctx->blobs, capacity * sizeof(blob_t));
+    if(NULL == tmp)
+    {
+        BLOB_ERROR("Out of memory");
+        return 0;
+    }
+    BLOB_MEMSET(&tmp[ctx->capacity], 0, (capacity - ctx->capacity) * sizeof(blob_t));
+    BLOB_STATS_ADD(ctx, blob_reallocs, 1);
+    BLOB_STATS_ADD(ctx, blob_bytes, capacity * sizeof(blob_t));
+    ctx->blobs = tmp;
+    ctx->capacity = capacity;
+    return 1;
+}
+
+/* Grow the point pool. */
+static int contour_pool_reserve(blob_context_t *ctx, size_t capacity)
+{
+    blob_coord_t *tmp;
+    if(capacity <= ctx->point_capacity)
+    {
+        return 1;
+    }
+    tmp = (blob_coord_t*)BLOB_REALLOC(ctx->points, capacity * (2 * sizeof(blob_coord_t)));
+    if(NULL == tmp)
+    {
+        BLOB_ERROR("Out of memory");
+        return 0;
+    }
+    BLOB_STATS_ADD(ctx, contour_reallocs, 1);
+    BLOB_STATS_ADD(ctx, contour_bytes, capacity * (2 * sizeof(blob_coord_t)));
+    ctx->points = tmp;
+    ctx->point_capacity = capacity;
+    return 1;
+}
+
+/* Grow the chain code pool. */
+static int contour_code_reserve(blob_context_t *ctx, size_t capacity)
+{
+    uint8_t *tmp;
+    if(capacity <= ctx->code_capacity)
+    {
+        return 1;
+    }
+    tmp = (uint8_t*)BLOB_REALLOC(ctx->codes, capacity);
+    if(NULL == tmp)
+    {
+        BLOB_ERROR("Out of memory");
+        return 0;
+    }
+    BLOB_STATS_ADD(ctx, contour_reallocs, 1);
+    BLOB_STATS_ADD(ctx, contour_bytes, capacity);
+    ctx->codes = tmp;
+    ctx->code_capacity = capacity;
+    return 1;
+}
+
+/* Add the chain code of the step to the next point of a contour (arena mode only). */
+static int contour_add_code(blob_context_t *ctx, contour_t *contour, int code)
+{
+    const size_t bit = 3 * (size_t)(contour->count - 1);
+    const size_t end = contour->code_offset + ((bit + 3 + 7) >> 3);
+    uint8_t *ptr;
+    if(end > ctx->code_count)
+    {
+        if(end > ctx->code_capacity)
+        {
+            if( !contour_code_reserve(ctx, ctx->code_capacity ? (ctx->code_capacity * 2) : 1024) )
+            {
+                return 0;
+            }
+        }
+        BLOB_MEMSET(ctx->codes + ctx->code_count, 0, end - ctx->code_count);
+        ctx->code_count = end;
+    }
+    ptr = ctx->codes + contour->code_offset + (bit >> 3);
+    ptr[0] |= (uint8_t)(code << (bit & 7));
+    if((bit & 7) > 5)
+    {
+        ptr[1] |= (uint8_t)(code >> (8 - (bit & 7)));
+    }
+    contour->count++;
+    return 1;
+}
+
+/* Add a point to contour */
+static int contour_add_point(blob_context_t *ctx, contour_t *contour, blob_coord_t x, blob_coord_t y)
+{
+    blob_coord_t *ptr;
+    if(ctx->arena)
+    {
+        /* Contours are traced one at a time, so the points of the current
+           contour are always at the end of the pool. */
+        if(ctx->point_count == ctx->point_capacity)
+        {
+            if( !contour_pool_reserve(ctx, ctx->point_capacity ? (ctx->point_capacity * 2) : 1024) )
+            {
+                return 0;
+            }
+        }
+        ptr = ctx->points + (ctx->point_count * 2);
+        ctx->point_count++;
+    }
+    else
+    {
+        if(contour->count == contour->capacity)
+        {
+            int newCapacity = contour->capacity ? (contour->capacity * 2) : 32;
+            blob_coord_t *tmp = (blob_coord_t*)BLOB_REALLOC(contour->points, newCapacity * (2 * sizeof(blob_coord_t)));
+            if(NULL == tmp)
+            {
+                BLOB_ERROR("Out of memory");
+                return 0;
+            }
+            BLOB_STATS_ADD(ctx, contour_reallocs, 1);
+            BLOB_STATS_ADD(ctx, contour_bytes, newCapacity * (2 * sizeof(blob_coord_t)));
+            contour->points = tmp;
+            contour->capacity = newCapacity;
+        }
+        ptr = contour->points + (contour->count * 2);
+    }
+    
+    ptr[0] = x;
+    ptr[1] = y;
+    
+    contour->count++;
+    return 1;
+}
+
+/* Move the last point of a contour (the contour must not be empty). */
+static void contour_move_point(blob_context_t *ctx, contour_t *contour, blob_coord_t x, blob_coord_t y)
+{
+    blob_coord_t *ptr = ctx->arena ? (ctx->points + ((ctx->point_count - 1) * 2))
+                                   : (contour->points + ((contour->count - 1) * 2));
+    ptr[0] = x;
+    ptr[1] = y;
+}
+
+/* Reset a contour before tracing. */
+static void contour_start(blob_context_t *ctx, contour_t *contour)
+{
+    if(ctx->arena && contour->capacity)
+    {
+        /* The slot was used by a call in per-contour mode. */
+        BLOB_FREE(contour->points);
+        contour->points = NULL;
+        contour->capacity = 0;
+    }
+    else if(0 == contour->capacity)
+    {
+        /* The points may still reference the pool of a previous call. */
+        contour->points = NULL;
+    }
+    contour->offset = ctx->point_count;
+    contour->code_offset = ctx->code_count;
+    contour->codes = NULL;
+    contour->count = 0;
+}
+
+/* Make a contour point into the pools. */
+static void contour_bind(blob_context_t *ctx, contour_t *c, int chain)
+{
+    c->points = c->count ? (ctx->points + (c->offset * 2)) : NULL;
+    c->codes  = (chain && (c->count > 1)) ? (ctx->codes + c->code_offset) : NULL;
+}
+
+/* Make contours point into the pools once they will not be reallocated
+   anymore. Internal contours are only bound if BLOB_EXTRACT_INTERNAL is set. */
+static void contour_pool_bind(blob_context_t *ctx, int flags)
+{
+    const int chain = flags & BLOB_CHAIN_CODES;
+    int i, j;
+    if(!ctx->arena)
+    {
+        return;
+    }
+    for(i=0; i<ctx->count; i++)
+    {
+        blob_t *b = ctx->blobs + i;
+        contour_bind(ctx, &b->external, chain);
+        if(flags & BLOB_EXTRACT_INTERNAL)
+        {
+            for(j=0; j<b->internal_count; j++)
+            {
+                contour_bind(ctx, b->internal + j, chain);
+            }
+        }
+    }
+}
+
+/* Add a new blob.
+   The slots past the current blob count may have been used by a previous
+   call. Their contour arrays are kept and reused. */
+static int blob_add(blob_context_t *ctx)
+{
+    blob_t *b;
+    if(ctx->count == ctx->capacity)
+    {
+        if( !blob_reserve(ctx, ctx->capacity ? (ctx->capacity * 2) : 64) )
+        {
+            return 0;
+        }
+    }
+    b = &ctx->blobs[ctx->count++];
+    contour_start(ctx, &b->external);
+    b->internal_count = 0;
+    b->parent = b->hole = b->child = b->sibling = -1;
+    BLOB_MEMSET(&b->features, 0, sizeof(blob_features_t));
+    return 1;
+}
+
+/* Add internal contour */
+static int blob_add_internal(blob_context_t *ctx, blob_t *b)
+{
+    if(b->internal_count == b->internal_capacity)
+    {
+        int newCapacity = b->internal_capacity ? (b->internal_capacity * 2) : 4;
+        contour_t *tmp = (contour_t*)BLOB_REALLOC(b->internal, newCapacity * sizeof(contour_t));
+        if(NULL == tmp)
+        {
+            BLOB_ERROR("Out of memory");
+            return 0;
+        }
+        BLOB_MEMSET(&tmp[b->internal_capacity], 0, (newCapacity - b->internal_capacity) * sizeof(contour_t));
+        BLOB_STATS_ADD(ctx, contour_reallocs, 1);
+        BLOB_STATS_ADD(ctx, contour_bytes, newCapacity * sizeof(contour_t));
+        b->internal = tmp;
+        b->internal_capacity = newCapacity;
+    }
+    contour_start(ctx, &b->internal[b->internal_count++]);
+    return 1;
+}
+
+/* Get the counters of the last call to find_blobs. */
+void find_blobs_stats(blob_stats_t *stats)
+{
+    if(NULL != stats)
+    {
+#if defined(BLOB_STATS)
+        *stats = blob_find_blobs_stats;
+#else
+        BLOB_MEMSET(stats, 0, sizeof(blob_stats_t));
+#endif
+    }
+}
+
+/* Destroy all blobs created by find_blobs. */
+void destroy_blobs(blob_t *blobs, int count)
+{
+    int i;
+    if(NULL == blobs)
+    {
+        return;
+    }
+    
+    for(i=0; i<count; i++)
+    {
+        /* Points stored in a context pool are not owned by the contour. */
+        if(blobs[i].external.capacity)
+        {
+            BLOB_FREE(blobs[i].external.points);
+        }
+
+        if(NULL != blobs[i].internal)
+        {
+            int j;
+            for(j=0; j<blobs[i].internal_capacity; j++)
+            {
+                if(blobs[i].internal[j].capacity)
+                {
+                    BLOB_FREE(blobs[i].internal[j].points);
+                }
+            }
+            BLOB_FREE(blobs[i].internal);
+        }
+    }
+    BLOB_FREE(blobs);
+}
+
+/* Get the points of a contour. */
+void contour_decode(const contour_t *contour, blob_coord_t *points)
+{
+    static const int dx[8] = { 1, 1, 0,-1,-1,-1, 0, 1 };
+    static const int dy[8] = { 0, 1, 1, 1, 0,-1,-1,-1 };
+    size_t bit;
+    int k;
+    if(NULL == contour->codes)
+    {
+        if(contour->count)
+        {
+            memcpy(points, contour->points, contour->count * (2 * sizeof(blob_coord_t)));
+        }
+        return;
+    }
+    points[0] = contour->points[0];
+    points[1] = contour->points[1];
+    for(k=1, bit=0; k<contour->count; k++, bit+=3, points+=2)
+    {
+        const uint8_t *ptr = contour->codes + (bit >> 3);
+        int code = ptr[0] >> (bit & 7);
+        if((bit & 7) > 5)
+        {
+            code |= ptr[1] << (8 - (bit & 7));
+        }
+        code &= 7;
+        points[2] = points[0] + dx[code];
+        points[3] = points[1] + dy[code];
+    }
+}
+
+/* Number of internal contours of a blob stored in a binary blob set. */
+static int blob_file_internal(const blob_t *b, int flags)
+{
+    return ((flags & BLOB_EXTRACT_INTERNAL) && (NULL != b->internal)) ? b->internal_count : 0;
+}
+
+/* Get the size of the binary blob set holding some blobs. */
+size_t blob_file_size(const blob_t *blobs, int count, int flags)
+{
+    size_t contours = 0, points = 0;
+    int i, j;
+    for(i=0; i<count; i++)
+    {
+        const blob_t *b = blobs + i;
+        const int internal = blob_file_internal(b, flags);
+        points += b->external.count;
+        for(j=0; j<internal; j++)
+        {
+            points += b->internal[j].count;
+        }
+        contours += 1 + internal;
+    }
+    points = ((points * 2 * sizeof(blob_coord_t)) + 7) & ~(size_t)7;
+    return sizeof(blob_file_header_t) + (count * sizeof(blob_file_blob_t)) + (contours * sizeof(blob_file_contour_t)) + points;
+}
+
+/* Store blobs as a binary blob set. */
+size_t blob_file_write(const blob_t *blobs, int count, int flags, void *buffer, size_t size)
+{
+    blob_file_header_t *header = (blob_file_header_t*)buffer;
+    blob_file_blob_t *record;
+    blob_file_contour_t *contour;
+    blob_coord_t *points;
+    uint64_t offset;
+    size_t total;
+    int i, j, contours;
+
+    if((NULL == buffer) || (count < 0) || ((count > 0) && (NULL == blobs)))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    total = blob_file_size(blobs, count, flags);
+    if(size < total)
+    {
+        BLOB_ERROR("Buffer too small");
+        return 0;
+    }
+    for(i=0, contours=0; i<count; i++)
+    {
+        contours += 1 + blob_file_internal(blobs + i, flags);
+    }
+    BLOB_MEMSET(buffer, 0, total);
+
+    record  = (blob_file_blob_t*)(header + 1);
+    contour = (blob_file_contour_t*)(record + count);
+    points  = (blob_coord_t*)(contour + contours);
+
+    memcpy(header->magic, "BLOB", 4);
+    header->version = BLOB_FILE_VERSION;
+    header->coord_size = sizeof(blob_coord_t);
+    header->count = (uint32_t)count;
+    header->contour_count = (uint32_t)contours;
+    header->size = total;
+
+    for(i=0, offset=0, contours=0; i<count; i++, record++)
+    {
+        const blob_t *b = blobs + i;
+        const blob_features_t *f = &b->features;
+        const int internal = blob_file_internal(b, flags);
+        record->label = b->label;
+        record->x = b->x;
+        record->y = b->y;
+        record->cls = b->cls;
+        record->internal_count = b->internal_count;
+        record->contour = (uint32_t)contours;
+        record->contour_count = (uint32_t)(1 + internal);
+        record->perimeter = f->perimeter;
+        record->area = f->area;
+        record->min_x = f->min_x;
+        record->min_y = f->min_y;
+        record->max_x = f->max_x;
+        record->max_y = f->max_y;
+        record->sum_x = f->sum_x;
+        record->sum_y = f->sum_y;
+        record->sum_xx = f->sum_xx;
+        record->sum_yy = f->sum_yy;
+        record->sum_xy = f->sum_xy;
+        for(j=-1; j<internal; j++, contour++, contours++)
+        {
+            const contour_t *c = (j < 0) ? &b->external : (b->internal + j);
+            contour->offset = offset;
+            contour->count = (uint32_t)c->count;
+            contour_decode(c, points + (2 * offset));
+            offset += c->count;
+        }
+    }
+    header->point_count = offset;
+    return total;
+}
+
+/* Open a binary blob set without copying it. */
+int blob_file_open(blob_file_t *file, const void *data, size_t size)
+{
+    const blob_file_header_t *header = (const blob_file_header_t*)data;
+    uint64_t tables;
+    uint32_t i;
+
+    if((NULL == file) || (NULL == data))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if((size < sizeof(blob_file_header_t)) || memcmp(header->magic, "BLOB", 4))
+    {
+        BLOB_ERROR("Invalid blob file");
+        return 0;
+    }
+    if((BLOB_FILE_VERSION != header->version) || (sizeof(blob_coord_t) != header->coord_size))
+    {
+        BLOB_ERROR("Unsupported blob file version, byte order or coordinate type");
+        return 0;
+    }
+    tables = sizeof(blob_file_header_t) + ((uint64_t)header->count * sizeof(blob_file_blob_t))
+           + ((uint64_t)header->contour_count * sizeof(blob_file_contour_t));
+    if(   (header->size > size) || (tables > header->size)
+       || (header->point_count > ((header->size - tables) / (2 * sizeof(blob_coord_t)))) )
+    {
+        BLOB_ERROR("Truncated blob file");
+        return 0;
+    }
+
+    file->header   = header;
+    file->blobs    = (const blob_file_blob_t*)(header + 1);
+    file->contours = (const blob_file_contour_t*)(file->blobs + header->count);
+    file->points   = (const blob_coord_t*)(file->contours + header->contour_count);
+
+    for(i=0; i<header->count; i++)
+    {
+        const blob_file_blob_t *b = file->blobs + i;
+        if((b->contour > header->contour_count) || (b->contour_count > (header->contour_count - b->contour)))
+        {
+            BLOB_ERROR("Invalid blob file");
+            return 0;
+        }
+    }
+    for(i=0; i<header->contour_count; i++)
+    {
+        const blob_file_contour_t *c = file->contours + i;
+        if((c->offset > header->point_count) || (c->count > (header->point_count - c->offset)))
+        {
+            BLOB_ERROR("Invalid blob file");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Initialize an empty context. */
+void blob_context_init(blob_context_t *ctx)
+{
+    BLOB_MEMSET(ctx, 0, sizeof(blob_context_t));
+    ctx->arena = 1;
+}
+
+/* Discard the blobs and labels stored in a context. */
+void blob_context_reset(blob_context_t *ctx)
+{
+    ctx->label_w = 0;
+    ctx->label_h = 0;
+    ctx->count = 0;
+    ctx->point_count = 0;
+    ctx->code_count = 0;
+    ctx->update_flags = 0;
+}
+
+/* Preallocate blobs and contour points. */
+int blob_context_reserve(blob_context_t *ctx, int blobs, size_t points)
+{
+    if(NULL == ctx)
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    return blob_reserve(ctx, blobs) && contour_pool_reserve(ctx, points);
+}
+
+/* Release all the memory held by a context. */
+void blob_context_destroy(blob_context_t *ctx)
+{
+    if(NULL != ctx->label)
+    {
+        BLOB_FREE(ctx->label);
+    }
+    /* The slots past ctx->count may still hold contour arrays. */
+    destroy_blobs(ctx->blobs, ctx->capacity);
+    if(NULL != ctx->points)
+    {
+        BLOB_FREE(ctx->points);
+    }
+    if(NULL != ctx->codes)
+    {
+        BLOB_FREE(ctx->codes);
+    }
+    if(NULL != ctx->bits)
+    {
+        BLOB_FREE(ctx->bits);
+    }
+    if(NULL != ctx->scratch)
+    {
+        BLOB_FREE(ctx->scratch);
+    }
+    if(NULL != ctx->regions)
+    {
+        BLOB_FREE(ctx->regions);
+    }
+    if(NULL != ctx->workers)
+    {
+        int i;
+        for(i=0; i<ctx->worker_count; i++)
+        {
+            blob_context_destroy(ctx->workers + i);
+        }
+        BLOB_FREE(ctx->workers);
+    }
+    blob_context_init(ctx);
+}
+
+/* Input image formats. */
+#define BLOB_FORMAT_U8  0   /* 1 byte per pixel, 0 is background. */
+#define BLOB_FORMAT_BIT 1   /* 1 bit per pixel, most significant bit first. */
+#define BLOB_FORMAT_RANGE 2 /* 1 byte per pixel, foreground values in [lo, lo+span]. */
+#define BLOB_FORMAT_CLASS 3 /* 1 byte per pixel, pixels grouped by equal non-zero value. */
+#define BLOB_FORMAT_PADDED 4 /* 1 byte per pixel, 0 is background, with a background border around the ROI. */
+
+/* Input image. */
+typedef struct
+{
+    /* Pointer to the first row of the ROI. */
+    const uint8_t *data;
+    /* Number of bytes between 2 consecutive rows. */
+    ptrdiff_t stride;
+    /* Index of the first ROI pixel in a row (only used for 1bpp images). */
+    blob_coord_t x;
+    /* Lower bound and width of the foreground range (only used for range thresholding).
+       For multi-class images, lo is the class of the traced blob. */
+    uint8_t lo, span;
+} blob_source_t;
+
+/* Test if a pixel value belongs to the foreground (1 byte per pixel
+   formats, except multi-class images). */
+static BLOB_INLINE int source_test(const blob_source_t *src, int format, uint8_t v)
+{
+    if(BLOB_FORMAT_RANGE == format)
+    {
+        /* lo <= v <= lo+span with a single unsigned comparison. */
+        return (uint8_t)(v - src->lo) <= src->span;
+    }
+    return 0 != v;
+}
+
+/* Test if the pixel at (x,y) in the ROI belongs to the foreground. */
+static BLOB_INLINE int source_get(const blob_source_t *src, int format, blob_coord_t x, blob_coord_t y)
+{
+    const uint8_t *line = src->data + (src->stride * y);
+    if(BLOB_FORMAT_BIT == format)
+    {
+        const ptrdiff_t bit = src->x + x;
+        return (line[bit >> 3] >> (7 - (bit & 7))) & 1;
+    }
+    if(BLOB_FORMAT_RANGE == format)
+    {
+        /* lo <= v <= lo+span with a single unsigned comparison. */
+        return (uint8_t)(line[x] - src->lo) <= src->span;
+    }
+    if(BLOB_FORMAT_CLASS == format)
+    {
+        return line[x] == src->lo;
+    }
+    return 0 != line[x];
+}
+
+/* Return the index of the first non-zero byte of line starting at x, or
+   roi_w if there is none. */
+static BLOB_INLINE blob_coord_t source_skip_u8(const uint8_t *line, blob_coord_t x, blob_coord_t roi_w)
+{
+#if defined(BLOB_SIMD_AVX2)
+    const __m256i zero = _mm256_setzero_si256();
+    for(; (x + 32) <= roi_w; x += 32)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(line + x));
+        const uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        if(mask) { return x + blob_ctz32(mask); }
+    }
+#elif defined(BLOB_SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for(; (x + 16) <= roi_w; x += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(line + x));
+        const uint32_t mask = 0xffff ^ (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        if(mask) { return x + blob_ctz32(mask); }
+    }
+#elif defined(BLOB_SIMD_NEON)
+    for(; (x + 16) <= roi_w; x += 16)
+    {
+        /* Narrow the comparison result to 4 bits per byte. */
+        const uint8x16_t v = vtstq_u8(vld1q_u8(line + x), vdupq_n_u8(0xff));
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+        if(mask) { return x + (blob_ctz64(mask) >> 2); }
+    }
+#endif
+    for(; (x < roi_w) && (0 == line[x]); x++)
+    {}
+    return x;
+}
+
+/* Return the index of the first byte of line in [lo, lo+span] starting at
+   x, or roi_w if there is none. */
+static BLOB_INLINE blob_coord_t source_skip_range(const uint8_t *line, blob_coord_t x, blob_coord_t roi_w, uint8_t lo, uint8_t span)
+{
+    /* v-lo <= span is tested as min(v-lo, span) == v-lo. */
+#if defined(BLOB_SIMD_AVX2)
+    const __m256i vlo = _mm256_set1_epi8((char)lo);
+    const __m256i vspan = _mm256_set1_epi8((char)span);
+    for(; (x + 32) <= roi_w; x += 32)
+    {
+        const __m256i d = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)(line + x)), vlo);
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(d, vspan), d));
+        if(mask) { return x + blob_ctz32(mask); }
+    }
+#elif defined(BLOB_SIMD_SSE2)
+    const __m128i vlo = _mm_set1_epi8((char)lo);
+    const __m128i vspan = _mm_set1_epi8((char)span);
+    for(; (x + 16) <= roi_w; x += 16)
+    {
+        const __m128i d = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(line + x)), vlo);
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, vspan), d));
+        if(mask) { return x + blob_ctz32(mask); }
+    }
+#elif defined(BLOB_SIMD_NEON)
+    const uint8x16_t vlo = vdupq_n_u8(lo);
+    const uint8x16_t vspan = vdupq_n_u8(span);
+    for(; (x + 16) <= roi_w; x += 16)
+    {
+        const uint8x16_t v = vcleq_u8(vsubq_u8(vld1q_u8(line + x), vlo), vspan);
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+        if(mask) { return x + (blob_ctz64(mask) >> 2); }
+    }
+#endif
+    for(; (x < roi_w) && ((uint8_t)(line[x] - lo) > span); x++)
+    {}
+    return x;
+}
+
+/* Return the X coordinate of the first foreground pixel of row y starting
+   at x, or roi_w if there is none. */
+static BLOB_INLINE blob_coord_t source_next(const blob_source_t *src, int format, blob_coord_t x, blob_coord_t y, blob_coord_t roi_w)
+{
+    const uint8_t *line = src->data + (src->stride * y);
+    if(BLOB_FORMAT_BIT == format)
+    {
+        ptrdiff_t bit = src->x + x;
+        const ptrdiff_t end = src->x + roi_w;
+        /* Finish the current byte. */
+        for(; (bit < end) && (bit & 7); bit++)
+        {
+            if((line[bit >> 3] >> (7 - (bit & 7))) & 1) { return (blob_coord_t)(bit - src->x); }
+        }
+        /* Skip background 64 pixels at a time. */
+        for(; (bit + 64) <= end; bit += 64)
+        {
+            uint64_t word;
+            memcpy(&word, line + (bit >> 3), sizeof(word));
+            if(word) { break; }
+        }
+        for(; ((bit + 8) <= end) && (0 == line[bit >> 3]); bit += 8)
+        {}
+        for(; bit < end; bit++)
+        {
+            if((line[bit >> 3] >> (7 - (bit & 7))) & 1) { return (blob_coord_t)(bit - src->x); }
+        }
+        return roi_w;
+    }
+    if(BLOB_FORMAT_RANGE == format)
+    {
+        return source_skip_range(line, x, roi_w, src->lo, src->span);
+    }
+    return source_skip_u8(line, x, roi_w);
+}
+
+/* Extract blob contour (external or internal).
+   `mode` holds the `BLOB_CHAIN_CODES` and `BLOB_SIMPLIFY` flags.
+   Return the number of contour points, or 0 if an error occured. */
+static BLOB_INLINE int contour_trace_impl(blob_context_t *ctx, int format, const blob_source_t *src,
+                                          uint8_t external, label_t current, blob_coord_t x, blob_coord_t y,
+                                          blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                                          label_t *label, ptrdiff_t label_stride, contour_t *contour, int mode)
+{
+    static const int dx[8] = { 1, 1, 0,-1,-1,-1, 0, 1 };
+    static const int dy[8] = { 0, 1, 1, 1, 0,-1,-1,-1 };
+
+    int i = external ? 7 : 3;
+    int j;
+
+    blob_coord_t x0 = x;
+    blob_coord_t y0 = y;
+
+    blob_coord_t xx = -1;
+    blob_coord_t yy = -1;
+
+    /* Direction of the step to the current pixel, and of the one before. */
+    int step = -1;
+    int last = -1;
+    /* Number of contour points. */
+    int points = 0;
+
+    const int chain = mode & BLOB_CHAIN_CODES;
+    const int simplify = mode & BLOB_SIMPLIFY;
+
+    /* Current label, and offsets of its neighbours in the label buffer.
+       The current pixel of padded images is followed in the input buffer
+       too. */
+    label_t *mark = label + x0 + (label_stride * y0);
+    const uint8_t *pixel = (BLOB_FORMAT_PADDED == format) ? (src->data + x0 + (src->stride * y0)) : src->data;
+    ptrdiff_t label_step[8], pixel_step[8];
+    for(j=0; j<8; j++)
+    {
+        label_step[j] = dx[j] + (label_stride * dy[j]);
+        pixel_step[j] = dx[j] + (src->stride * dy[j]);
+    }
+
+    *mark = current;
+
+    for(int done = 0; !done; )
+    {
+        BLOB_STATS_ADD(ctx, trace_steps, 1);
+        points++;
+        if(NULL != contour)
+        {
+            if(simplify && (step >= 0) && (step == last) && (contour->count > 1))
+            {
+                /* Same direction as the previous step: the last point is
+                   in the middle of a straight run, and is replaced. */
+                contour_move_point(ctx, contour, roi_x+x0, roi_y+y0);
+            }
+            else
+            {
+                const int ok = (chain && (step >= 0)) ? contour_add_code(ctx, contour, step)
+                                                      : contour_add_point(ctx, contour, roi_x+x0, roi_y+y0);
+                if(!ok)
+                {
+                    return 0;
+                }
+            }
+            last = step;
+        }
+
+        /* Scan around current pixel in clockwise order. */
+        for(j=0; j<8; j++, i=(i+1)&7)
+        {
+            const blob_coord_t x1 = x0 + dx[i];
+            const blob_coord_t y1 = y0 + dy[i];
+            label_t *neighbour;
+            int foreground;
+            if(BLOB_FORMAT_PADDED == format)
+            {
+                /* The border around the ROI is background and can be
+                   marked, so the neighbours need no bounds checks. */
+                neighbour = mark + label_step[i];
+                foreground = (0 != pixel[pixel_step[i]]);
+            }
+            else
+            {
+                if((x1 < 0) || (x1 >= roi_w)) { continue; }
+                if((y1 < 0) || (y1 >= roi_h)) { continue; }
+                neighbour = label + x1 + (label_stride * y1);
+                foreground = source_get(src, format, x1, y1);
+            }
+
+            if(foreground)
+            {
+                break;
+            }
+            else if(BLOB_FORMAT_CLASS == format)
+            {
+                /* The pixel may belong to another class, so it is marked in
+                   the bitmap instead. Only the pixel above it tests the mark. */
+                if((y1 > 0) && source_get(src, format, x1, y1-1))
+                {
+                    ctx->bits[x1 + ((ptrdiff_t)roi_w * y1)] = 1;
+                }
+            }
+            else
+            {
+                *neighbour = -1;
+            }
+        }
+
+        if(j < 8)
+        {
+            /* Move to the foreground neighbour i. */
+            const blob_coord_t x1 = x0 + dx[i];
+            const blob_coord_t y1 = y0 + dy[i];
+            mark += label_step[i];
+            *mark = current;
+
+            if((xx < 0) && (yy < 0))
+            {
+                xx = x1;
+                yy = y1;
+            }
+            else
+            {
+                /* We are done if we crossed the first 2 contour points again. */
+                done =    ((x == x0) && (xx == x1)) 
+                       && ((y == y0) && (yy == y1));
+            }           
+            x0 = x1;
+            y0 = y1;
+            step = i;
+            if(BLOB_FORMAT_PADDED == format)
+            {
+                pixel += pixel_step[i];
+            }
+        }
+        else
+        {
+            /* Isolated point. */
+            done = 1;
+        }
+        /* Compute next start position. */
+        /* 1. Compute the neighbour index of the previous point. */
+        int previous = (i+4) & 7;
+        /* 2. Next search index is previous + 2 (mod 8). */
+        i = (previous + 2) & 7;
+    }
+    
+    return points;
+}
+
+/* Contour tracers specialized for each input format. */
+static int contour_trace_u8(blob_context_t *ctx, const blob_source_t *src,
+                            uint8_t external, label_t current, blob_coord_t x, blob_coord_t y,
+                            blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                            label_t *label, ptrdiff_t label_stride, contour_t *contour, int mode)
+{
+    return contour_trace_impl(ctx, BLOB_FORMAT_U8, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+}
+
+static int contour_trace_bit(blob_context_t *ctx, const blob_source_t *src,
+                             uint8_t external, label_t current, blob_coord_t x, blob_coord_t y,
+                             blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                             label_t *label, ptrdiff_t label_stride, contour_t *contour, int mode)
+{
+    return contour_trace_impl(ctx, BLOB_FORMAT_BIT, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+}
+
+static int contour_trace_range(blob_context_t *ctx, const blob_source_t *src,
+                               uint8_t external, label_t current, blob_coord_t x, blob_coord_t y,
+                               blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                               label_t *label, ptrdiff_t label_stride, contour_t *contour, int mode)
+{
+    return contour_trace_impl(ctx, BLOB_FORMAT_RANGE, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+}
+
+static int contour_trace_padded(blob_context_t *ctx, const blob_source_t *src,
+                                uint8_t external, label_t current, blob_coord_t x, blob_coord_t y,
+                                blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                                label_t *label, ptrdiff_t label_stride, contour_t *contour, int mode)
+{
+    return contour_trace_impl(ctx, BLOB_FORMAT_PADDED, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+}
+
+static int contour_trace_class(blob_context_t *ctx, const blob_source_t *src,
+                               uint8_t external, label_t current, blob_coord_t x, blob_coord_t y,
+                               blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                               label_t *label, ptrdiff_t label_stride, contour_t *contour, int mode)
+{
+    return contour_trace_impl(ctx, BLOB_FORMAT_CLASS, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+}
+
+static BLOB_INLINE int contour_trace(blob_context_t *ctx, int format, const blob_source_t *src,
+                                     uint8_t external, label_t current, blob_coord_t x, blob_coord_t y,
+                                     blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                                     label_t *label, ptrdiff_t label_stride, contour_t *contour, int mode)
+{
+    if(BLOB_FORMAT_BIT == format)
+    {
+        return contour_trace_bit(ctx, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+    }
+    if(BLOB_FORMAT_RANGE == format)
+    {
+        return contour_trace_range(ctx, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+    }
+    if(BLOB_FORMAT_CLASS == format)
+    {
+        return contour_trace_class(ctx, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+    }
+    if(BLOB_FORMAT_PADDED == format)
+    {
+        return contour_trace_padded(ctx, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+    }
+    return contour_trace_u8(ctx, src, external, current, x, y, roi_x, roi_y, roi_w, roi_h, label, label_stride, contour, mode);
+}
+
+/* Grow the label buffer (its content does not need to be preserved). */
+static int blob_label_reserve(blob_context_t *ctx, size_t label_count)
+{
+    if(label_count > ctx->label_capacity)
+    {
+        if(NULL != ctx->label)
+        {
+            BLOB_FREE(ctx->label);
+        }
+        ctx->label_capacity = 0;
+        ctx->label = (label_t*)BLOB_MALLOC(label_count * sizeof(label_t));
+        if(NULL == ctx->label)
+        {
+            BLOB_ERROR("Out of memory");
+            return 0;
+        }
+        ctx->label_capacity = label_count;
+    }
+    return 1;
+}
+
+/* Grow the 1bpp bitmap (its content does not need to be preserved). */
+static int blob_bits_reserve(blob_context_t *ctx, size_t size)
+{
+    if(size > ctx->bits_capacity)
+    {
+        if(NULL != ctx->bits)
+        {
+            BLOB_FREE(ctx->bits);
+        }
+        ctx->bits_capacity = 0;
+        ctx->bits = (uint8_t*)BLOB_MALLOC(size);
+        if(NULL == ctx->bits)
+        {
+            BLOB_ERROR("Out of memory");
+            return 0;
+        }
+        ctx->bits_capacity = size;
+    }
+    return 1;
+}
+
+/* Grow the temporary buffer (its content is preserved). */
+static int blob_scratch_reserve(blob_context_t *ctx, size_t size)
+{
+    void *tmp;
+    if(size <= ctx->scratch_capacity)
+    {
+        return 1;
+    }
+    tmp = BLOB_REALLOC(ctx->scratch, size);
+    if(NULL == tmp)
+    {
+        BLOB_ERROR("Out of memory");
+        return 0;
+    }
+    ctx->scratch = tmp;
+    ctx->scratch_capacity = size;
+    return 1;
+}
+
+/* Clamp the ROI to the image dimensions.
+   roi_w and roi_h are set to 0 if there is nothing to do. */
+static void blob_roi_clamp(blob_coord_t *roi_x, blob_coord_t *roi_y, blob_coord_t *roi_w, blob_coord_t *roi_h,
+                           blob_coord_t in_w, blob_coord_t in_h)
+{
+    if((*roi_x >= in_w) || (*roi_y >= in_h))
+    {
+        /* nothing to do */
+        *roi_w = *roi_h = 0;
+        return;
+    }
+    if(*roi_x < 0) { *roi_x = 0; }
+    if(*roi_y < 0) { *roi_y = 0; }
+    if((*roi_x + *roi_w) > in_w) { *roi_w = in_w - *roi_x; }
+    if((*roi_y + *roi_h) > in_h) { *roi_h = in_h - *roi_y; }
+    if((*roi_w <= 0) || (*roi_h <= 0))
+    {
+        /* nothing to do */
+        *roi_w = *roi_h = 0;
+    }
+}
+
+/* Discard the previous results and clamp the ROI to the image dimensions.
+   roi_w and roi_h are set to 0 if there is nothing to do. */
+static int find_blobs_clamp(blob_context_t *ctx,
+                            blob_coord_t *roi_x, blob_coord_t *roi_y, blob_coord_t *roi_w, blob_coord_t *roi_h,
+                            blob_coord_t in_w, blob_coord_t in_h, int flags)
+{
+    blob_context_reset(ctx);
+    BLOB_MEMSET(&ctx->stats, 0, sizeof(blob_stats_t));
+
+    if((flags & BLOB_CHAIN_CODES) && !ctx->arena)
+    {
+        BLOB_ERROR("Chain codes require the arena mode");
+        return 0;
+    }
+    if((flags & BLOB_CHAIN_CODES) && (flags & BLOB_SIMPLIFY))
+    {
+        BLOB_ERROR("Chain codes can not be simplified");
+        return 0;
+    }
+    if((flags & BLOB_COUNT_HOLES) && (flags & BLOB_EXTRACT_INTERNAL))
+    {
+        BLOB_ERROR("Holes can not be both counted and extracted");
+        return 0;
+    }
+    if((flags & BLOB_TWO_PASS) && ((flags & (BLOB_EXTRACT_INTERNAL | BLOB_NO_LABELS)) || (ctx->min_perimeter > 0)))
+    {
+        BLOB_ERROR("The two-pass labelling only computes labels");
+        return 0;
+    }
+    if((flags & BLOB_CONTOUR_TREE) && (flags & (BLOB_COUNT_HOLES | BLOB_TWO_PASS)))
+    {
+        BLOB_ERROR("The contour tree requires the holes to be traced");
+        return 0;
+    }
+
+    /* adjust ROI */
+    blob_roi_clamp(roi_x, roi_y, roi_w, roi_h, in_w, in_h);
+    return 1;
+}
+
+/* Clamp the ROI to the image dimensions and prepare the label buffer.
+   roi_w and roi_h are set to 0 if there is nothing to do. The label buffer
+   is only cleared if clear is set. */
+static int find_blobs_prepare(blob_context_t *ctx,
+                              blob_coord_t *roi_x, blob_coord_t *roi_y, blob_coord_t *roi_w, blob_coord_t *roi_h,
+                              blob_coord_t in_w, blob_coord_t in_h, int flags, int clear)
+{
+    size_t label_count;
+
+    if( !find_blobs_clamp(ctx, roi_x, roi_y, roi_w, roi_h, in_w, in_h, flags) )
+    {
+        return 0;
+    }
+    if(0 == *roi_w)
+    {
+        return 1;
+    }
+
+    /* grow label buffer if needed. */
+    label_count = (size_t)*roi_w * (size_t)*roi_h;
+    if( !blob_label_reserve(ctx, label_count) )
+    {
+        return 0;
+    }
+    ctx->label_w = *roi_w;
+    ctx->label_h = *roi_h;
+    
+    if(clear)
+    {
+        BLOB_MEMSET(ctx->label, 0, label_count * sizeof(label_t));
+    }
+    return 1;
+}
+
+/* Sum of the integers in [0,n[ and of their squares. */
+static BLOB_INLINE int64_t blob_sum1(int64_t n) { return (n * (n - 1)) / 2; }
+static BLOB_INLINE int64_t blob_sum2(int64_t n) { return (n * (n - 1) * ((2 * n) - 1)) / 6; }
+
+/* Add a horizontal run of n pixels starting at (x,y) to blob features. */
+static BLOB_INLINE void blob_features_add_run(blob_features_t *f, blob_coord_t x, blob_coord_t y, blob_coord_t n, int second_order)
+{
+    const blob_coord_t x1 = x + n - 1;
+    const int64_t sx = (n * (int64_t)x) + blob_sum1(n);
+    if(0 == f->area)
+    {
+        f->min_x = x;
+        f->max_x = x1;
+        /* Runs are visited in raster order. */
+        f->min_y = y;
+    }
+    else
+    {
+        if(x  < f->min_x) { f->min_x = x; }
+        if(x1 > f->max_x) { f->max_x = x1; }
+    }
+    f->max_y = y;
+    f->area  += n;
+    f->sum_x += sx;
+    f->sum_y += n * (int64_t)y;
+    if(second_order)
+    {
+        f->sum_xx += blob_sum2((int64_t)x1 + 1) - blob_sum2(x);
+        f->sum_yy += n * (int64_t)y * y;
+        f->sum_xy += sx * y;
+    }
+}
+
+/* Test if a blob is discarded by the filters. */
+static BLOB_INLINE int blob_filtered(const blob_context_t *ctx, const blob_t *b)
+{
+    return (b->features.perimeter < ctx->min_perimeter) || (b->features.area < ctx->min_area);
+}
+
+/* Discard the blobs with fewer external contour points than
+   ctx->min_perimeter or fewer pixels than ctx->min_area, keeping the order
+   of the other ones. The points of the blobs discarded by their area stay
+   in the pool. If BLOB_ERASE_FILTERED is set, the labels of the discarded
+   blobs are cleared and the other blobs are renumbered. With
+   BLOB_CONTOUR_TREE, the blobs lying in a discarded blob are moved to the
+   hole containing it, and the parents are renumbered. */
+static int blob_filter(blob_context_t *ctx, label_t *label, ptrdiff_t label_stride, blob_coord_t roi_w, blob_coord_t roi_h, int flags)
+{
+    const int erase = (flags & BLOB_ERASE_FILTERED);
+    const int tree  = (flags & BLOB_CONTOUR_TREE);
+    label_t *map = NULL;
+    int *index = NULL;
+    blob_coord_t i, j;
+    int k, kept;
+
+    if((ctx->min_perimeter <= 0) && (ctx->min_area <= 0))
+    {
+        return 1;
+    }
+    if(erase || tree)
+    {
+        /* New index of each blob, then new label of each label. */
+        if( !blob_scratch_reserve(ctx, ((size_t)ctx->count * sizeof(int)) + (((size_t)ctx->count + 1) * sizeof(label_t))) )
+        {
+            return 0;
+        }
+        index = (int*)ctx->scratch;
+        map = (label_t*)(index + ctx->count);
+        map[0] = 0;
+    }
+    if(tree)
+    {
+        /* A parent comes before its children, so the parent of a discarded
+           blob is already a blob which is kept. */
+        for(k=0; k<ctx->count; k++)
+        {
+            blob_t *b = ctx->blobs + k;
+            if((b->parent >= 0) && blob_filtered(ctx, ctx->blobs + b->parent))
+            {
+                b->hole   = ctx->blobs[b->parent].hole;
+                b->parent = ctx->blobs[b->parent].parent;
+            }
+        }
+    }
+    for(k=0, kept=0; k<ctx->count; k++)
+    {
+        blob_t *b = ctx->blobs + k;
+        if(blob_filtered(ctx, b))
+        {
+            if(erase) { map[b->label] = 0; }
+            continue;
+        }
+        if(erase)
+        {
+            map[b->label] = (label_t)(kept + 1);
+            b->label = (label_t)(kept + 1);
+        }
+        if(tree)
+        {
+            index[k] = kept;
+            if(b->parent >= 0)
+            {
+                b->parent = index[b->parent];
+            }
+        }
+        if(k != kept)
+        {
+            /* Swap the blobs so that no contour array is lost. */
+            blob_t tmp = ctx->blobs[kept];
+            ctx->blobs[kept] = *b;
+            *b = tmp;
+        }
+        kept++;
+    }
+    if(erase && (kept != ctx->count))
+    {
+        for(j=0; j<roi_h; j++, label+=label_stride)
+        {
+            for(i=0; i<roi_w; i++)
+            {
+                if(label[i] > 0)
+                {
+                    label[i] = map[label[i]];
+                }
+            }
+        }
+    }
+    ctx->count = kept;
+    return 1;
+}
+
+/* Run of foreground pixels (BLOB_COUNT_HOLES and BLOB_TWO_PASS). */
+typedef struct
+{
+    blob_coord_t x0, x1, y;
+    /* Label of the run once its blob is known. */
+    label_t label;
+    /* Set of the runs (the index of its first run is the root). */
+    int parent;
+    /* Number of runs minus number of pairs of connected runs of the set
+       (only meaningful for its root). */
+    int euler;
+} blob_euler_run_t;
+
+static int blob_euler_find(blob_euler_run_t *runs, int i)
+{
+    while(runs[i].parent != i)
+    {
+        runs[i].parent = runs[runs[i].parent].parent;
+        i = runs[i].parent;
+    }
+    return i;
+}
+
+/* Merge the sets of 2 connected runs. */
+static void blob_euler_connect(blob_euler_run_t *runs, int a, int b)
+{
+    a = blob_euler_find(runs, a);
+    b = blob_euler_find(runs, b);
+    if(a > b)
+    {
+        int tmp = a; a = b; b = tmp;
+    }
+    if(a != b)
+    {
+        runs[b].parent = a;
+        runs[a].euler += runs[b].euler;
+    }
+    runs[a].euler--;
+}
+
+/* Background run (BLOB_CONTOUR_TREE). The background is 4-connected, so
+   each set of runs is either the background around the ROI (the set of
+   the first region) or a hole of a single blob. */
+typedef struct
+{
+    blob_coord_t x0, x1;
+    /* Set of the runs (the smallest index is the root). */
+    int parent;
+    /* Index of the blob and of the hole found with this run, or -1. */
+    int blob, hole;
+} blob_region_t;
+
+/* Hole found on a row, whose background starts on the next row. */
+typedef struct
+{
+    blob_coord_t x;
+    int blob, hole;
+} blob_hole_t;
+
+/* State of the contour tree during the scan. */
+typedef struct
+{
+    int count;
+    /* First region of the current row. */
+    int first;
+    /* First region of the previous row which may touch the next run. */
+    int previous;
+    /* Region on the left of the current pixel. */
+    int current;
+    /* Holes found on the previous row (in) and on the current row (out). */
+    blob_hole_t *in, *out;
+    int in_count, in_next, out_count;
+} blob_tree_t;
+
+/* Grow the region buffer (its content is preserved). */
+static int blob_regions_reserve(blob_context_t *ctx, size_t count)
+{
+    void *tmp;
+    size_t size;
+    if((count * sizeof(blob_region_t)) <= ctx->region_capacity)
+    {
+        return 1;
+    }
+    size = ctx->region_capacity ? (2 * ctx->region_capacity) : (1024 * sizeof(blob_region_t));
+    if(size < (count * sizeof(blob_region_t)))
+    {
+        size = count * sizeof(blob_region_t);
+    }
+    tmp = BLOB_REALLOC(ctx->regions, size);
+    if(NULL == tmp)
+    {
+        BLOB_ERROR("Out of memory");
+        return 0;
+    }
+    ctx->regions = tmp;
+    ctx->region_capacity = size;
+    return 1;
+}
+
+static int blob_region_find(blob_region_t *regions, int i)
+{
+    while(regions[i].parent != i)
+    {
+        regions[i].parent = regions[regions[i].parent].parent;
+        i = regions[i].parent;
+    }
+    return i;
+}
+
+static void blob_region_union(blob_region_t *regions, int a, int b)
+{
+    a = blob_region_find(regions, a);
+    b = blob_region_find(regions, b);
+    if(a < b)
+    {
+        regions[b].parent = a;
+    }
+    else if(b < a)
+    {
+        regions[a].parent = b;
+    }
+}
+
+/* Start the contour tree. The holes found on 2 consecutive rows are
+   stored in ctx->scratch, and region 0 is the background around the ROI. */
+static int blob_tree_begin(blob_context_t *ctx, blob_tree_t *tree, blob_coord_t roi_w)
+{
+    blob_region_t *regions;
+    if( !blob_scratch_reserve(ctx, 2 * (size_t)roi_w * sizeof(blob_hole_t)) || !blob_regions_reserve(ctx, 1) )
+    {
+        return 0;
+    }
+    regions = (blob_region_t*)ctx->regions;
+    regions[0].x0 = regions[0].x1 = 0;
+    regions[0].parent = 0;
+    regions[0].blob = regions[0].hole = -1;
+    tree->count = tree->first = tree->previous = 1;
+    tree->current = 0;
+    tree->in  = (blob_hole_t*)ctx->scratch;
+    tree->out = tree->in + roi_w;
+    tree->in_count = tree->in_next = tree->out_count = 0;
+    return 1;
+}
+
+/* Start a row. The holes found on the previous row are attached to the
+   runs of this one. */
+static void blob_tree_row(blob_tree_t *tree)
+{
+    blob_hole_t *tmp = tree->in;
+    tree->in  = tree->out;
+    tree->out = tmp;
+    tree->in_count  = tree->out_count;
+    tree->in_next   = 0;
+    tree->out_count = 0;
+    tree->previous  = tree->first;
+    tree->first     = tree->count;
+    tree->current   = 0;
+}
+
+/* Add the background run [x0,x1] of row j, and merge it with the runs of
+   the previous row it touches. */
+static int blob_tree_run(blob_context_t *ctx, blob_tree_t *tree, blob_coord_t x0, blob_coord_t x1, blob_coord_t j,
+                         blob_coord_t roi_w, blob_coord_t roi_h)
+{
+    blob_region_t *regions;
+    const int k = tree->count;
+    int m;
+    if( !blob_regions_reserve(ctx, (size_t)k + 1) )
+    {
+        return 0;
+    }
+    regions = (blob_region_t*)ctx->regions;
+    regions[k].x0 = x0;
+    regions[k].x1 = x1;
+    regions[k].parent = k;
+    regions[k].blob = regions[k].hole = -1;
+    tree->count++;
+    /* The pixels outside the ROI are background. */
+    if((0 == x0) || ((roi_w - 1) == x1) || (0 == j) || ((roi_h - 1) == j))
+    {
+        regions[k].parent = 0;
+    }
+    while((tree->previous < tree->first) && (regions[tree->previous].x1 < x0))
+    {
+        tree->previous++;
+    }
+    for(m=tree->previous; (m<tree->first) && (regions[m].x0 <= x1); m++)
+    {
+        blob_region_union(regions, m, k);
+    }
+    for(; (tree->in_next < tree->in_count) && (tree->in[tree->in_next].x <= x1); tree->in_next++)
+    {
+        if(tree->in[tree->in_next].x >= x0)
+        {
+            regions[k].blob = tree->in[tree->in_next].blob;
+            regions[k].hole = tree->in[tree->in_next].hole;
+        }
+    }
+    tree->current = k;
+    return 1;
+}
+
+/* Replace the region stored in the parent of each blob by the blob and
+   the hole containing it. */
+static void blob_tree_resolve(blob_context_t *ctx, blob_tree_t *tree)
+{
+    blob_region_t *regions = (blob_region_t*)ctx->regions;
+    int k;
+    for(k=1; k<tree->count; k++)
+    {
+        if(regions[k].blob >= 0)
+        {
+            const int r = blob_region_find(regions, k);
+            regions[r].blob = regions[k].blob;
+            regions[r].hole = regions[k].hole;
+        }
+    }
+    for(k=0; k<ctx->count; k++)
+    {
+        blob_t *b = ctx->blobs + k;
+        const int r = blob_region_find(regions, b->parent);
+        b->parent = regions[r].blob;
+        b->hole   = regions[r].hole;
+    }
+}
+
+/* Link the children of each blob once the filtered blobs are removed. */
+static void blob_tree_link(blob_context_t *ctx)
+{
+    int k, top = -1;
+    for(k=0; k<ctx->count; k++)
+    {
+        ctx->blobs[k].child = -1;
+    }
+    for(k=ctx->count-1; k>=0; k--)
+    {
+        blob_t *b = ctx->blobs + k;
+        if(b->parent >= 0)
+        {
+            b->sibling = ctx->blobs[b->parent].child;
+            ctx->blobs[b->parent].child = k;
+        }
+        else
+        {
+            b->sibling = top;
+            top = k;
+        }
+    }
+}
+
+/* Label the ROI and count the holes of each blob from its Euler number
+   (BLOB_COUNT_HOLES and BLOB_TWO_PASS).
+   1. The runs of foreground pixels are merged with the 8-connected runs of
+      the previous row. The runs are stored in ctx->scratch.
+   2. The runs are visited in raster order. The first run of a set starts
+      a new blob and its external contour is traced, unless BLOB_TWO_PASS
+      is set. The remaining runs are then labelled and added to the
+      features of their blob.
+   The blobs are found in the same order and with the same external
+   contours as with the contour tracing scan. Without the contours, both
+   passes read the image and write the labels row after row. */
+static BLOB_INLINE int find_blobs_scan_runs(blob_context_t *ctx, int format, const blob_source_t *src, label_t *label, ptrdiff_t label_stride,
+                                             blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                                             int flags, blob_contour_callback_t callback, void *user)
+{
+    blob_euler_run_t *runs = (blob_euler_run_t*)ctx->scratch;
+    size_t capacity = ctx->scratch_capacity / sizeof(blob_euler_run_t);
+    contour_t scratch;
+    blob_coord_t i, j, x0;
+    label_t current;
+    int count, first, previous, k;
+
+    const int extract_external = !(flags & BLOB_NO_EXTERNAL_POINTS);
+    const int fill_labels      = !(flags & BLOB_NO_LABELS);
+    const int second_order     = (flags & BLOB_SECOND_ORDER);
+    const int features         = (flags & BLOB_FEATURES) || second_order || (ctx->min_area > 0);
+    const int chain            = (flags & BLOB_CHAIN_CODES);
+    /* Contour storage mode of the tracer. */
+    const int mode             = (flags & (BLOB_CHAIN_CODES | BLOB_SIMPLIFY));
+    const int trace            = !(flags & BLOB_TWO_PASS);
+    /* Start of the scan, start of the current contour and total tracing time. */
+    uint64_t stats_start = 0, stats_t = 0, stats_trace = 0;
+
+    BLOB_STATS_TIME(stats_start);
+
+    /* 1. Merge the runs. */
+    count = 0;
+    previous = 0;
+    for(j=0; j<roi_h; j++)
+    {
+        first = count;
+        for(i=source_next(src, format, 0, j, roi_w); i<roi_w; i=source_next(src, format, i+1, j, roi_w))
+        {
+            x0 = i;
+            while(((i+1) < roi_w) && source_get(src, format, i+1, j))
+            {
+                i++;
+            }
+            BLOB_STATS_ADD(ctx, pixels, i + 1 - x0);
+            if((size_t)count == capacity)
+            {
+                capacity = capacity ? (capacity * 2) : 1024;
+                if( !blob_scratch_reserve(ctx, capacity * sizeof(blob_euler_run_t)) )
+                {
+                    return 0;
+                }
+                runs = (blob_euler_run_t*)ctx->scratch;
+            }
+            runs[count].x0 = x0;
+            runs[count].x1 = i;
+            runs[count].y  = j;
+            runs[count].parent = count;
+            runs[count].euler  = 1;
+            /* The runs of the previous row ending before x0-1 can not touch
+               this run, nor the next ones. */
+            while((previous < first) && (runs[previous].x1 < (x0 - 1)))
+            {
+                previous++;
+            }
+            for(k=previous; (k<first) && (runs[k].x0 <= (i + 1)); k++)
+            {
+                blob_euler_connect(runs, k, count);
+            }
+            count++;
+        }
+        previous = first;
+    }
+
+    /* 2. Create the blobs and label the runs. */
+    BLOB_MEMSET(&scratch, 0, sizeof(contour_t));
+    current = 1;
+    for(k=0; k<count; k++)
+    {
+        blob_euler_run_t *run = runs + k;
+        if(run->parent == k)
+        {
+            if(current == BLOB_LABEL_MAX)
+            {
+                BLOB_ERROR("Too many blobs for label_t");
+                return 0;
+            }
+            if( !blob_add(ctx) )
+            {
+                return 0;
+            }
+            blob_t *b = ctx->blobs + (ctx->count - 1);
+            b->label = current;
+            b->x = roi_x + run->x0;
+            b->y = roi_y + run->y;
+            b->cls = 1;
+            b->internal_count = 1 - run->euler;
+            if(trace)
+            {
+                /* trace external contour */
+                contour_t *external = extract_external ? &b->external : NULL;
+                if(NULL != callback)
+                {
+                    contour_start(ctx, &scratch);
+                    external = extract_external ? &scratch : NULL;
+                }
+                BLOB_STATS_TIME(stats_t);
+                const int perimeter = contour_trace(ctx, format, src, 1, current, run->x0, run->y, roi_x, roi_y, roi_w, roi_h, label, label_stride, external, mode);
+                if(!perimeter)
+                {
+                    return 0;
+                }
+                BLOB_STATS_ELAPSED(ctx, external_ns, stats_t, stats_trace);
+                BLOB_STATS_ADD(ctx, external_contours, 1);
+                b->features.perimeter = perimeter;
+                if(NULL != callback)
+                {
+                    if(perimeter >= ctx->min_perimeter)
+                    {
+                        contour_bind(ctx, &scratch, chain);
+                        if( !callback(b, &scratch, 0, user) )
+                        {
+                            return 0;
+                        }
+                    }
+                    ctx->point_count = scratch.offset;
+                    ctx->code_count  = scratch.code_offset;
+                }
+                else if((perimeter < ctx->min_perimeter) && (NULL != external))
+                {
+                    /* The blob will be discarded, so its points are released now. */
+                    if(ctx->arena)
+                    {
+                        ctx->point_count = external->offset;
+                        ctx->code_count  = external->code_offset;
+                    }
+                    external->count = 0;
+                }
+            }
+            run->label = current++;
+        }
+        else
+        {
+            /* The root of the set comes first, so its label is known. */
+            run->label = runs[blob_euler_find(runs, k)].label;
+        }
+        /* Like with the contour tracing scan, the first pixel of a run is
+           always labelled. */
+        label_t *ptr_label = label + (label_stride * run->y);
+        ptr_label[run->x0] = run->label;
+        if(fill_labels)
+        {
+            for(i=run->x0+1; i<=run->x1; i++)
+            {
+                ptr_label[i] = run->label;
+            }
+        }
+        if(features)
+        {
+            blob_features_add_run(&ctx->blobs[run->label-1].features, roi_x + run->x0, roi_y + run->y, run->x1 + 1 - run->x0, second_order);
+        }
+    }
+    if( !blob_filter(ctx, label, label_stride, roi_w, roi_h, flags) )
+    {
+        return 0;
+    }
+    contour_pool_bind(ctx, flags & ~BLOB_EXTRACT_INTERNAL);
+    BLOB_STATS_ADD(ctx, scan_ns, BLOB_STATS_NOW() - stats_start - stats_trace);
+    return 1;
+}
+
+/* Label the ROI and extract contours. 
+   The label buffer holds roi_h rows of roi_w labels, label_stride labels
+   apart, and must be cleared. 
+   If a callback is given, the contours are traced at the end of the point
+   pool (arena mode only), passed to the callback and discarded.
+   For multi-class images, the background pixels visited by the tracer are
+   marked in ctx->bits (roi_w * roi_h bytes, cleared) instead of the label
+   buffer. */
+static BLOB_INLINE int find_blobs_scan(blob_context_t *ctx, int format, const blob_source_t *src, label_t *label, ptrdiff_t label_stride,
+                                       blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                                       int flags, blob_contour_callback_t callback, void *user)
+{
+    label_t *line_label, *ptr_label;
+    contour_t scratch;
+    /* Source of the current pixel class (multi-class images only). */
+    blob_source_t class_src;
+    const blob_source_t *pixel_src = src;
+    uint8_t run_class = 0;
+
+    blob_coord_t i, j, last;
+    label_t current;
+    /* Label of the foreground pixel on the left of the current one, or 0. */
+    label_t run_label;
+
+    const int extract_internal = (flags & BLOB_EXTRACT_INTERNAL);
+    const int extract_external = !(flags & BLOB_NO_EXTERNAL_POINTS);
+    const int fill_labels      = !(flags & BLOB_NO_LABELS);
+    const int second_order     = (flags & BLOB_SECOND_ORDER);
+    const int features         = (flags & BLOB_FEATURES) || second_order || (ctx->min_area > 0);
+    const int chain            = (flags & BLOB_CHAIN_CODES);
+    /* Contour storage mode of the tracer. */
+    const int mode             = (flags & (BLOB_CHAIN_CODES | BLOB_SIMPLIFY));
+    const int tree             = (flags & BLOB_CONTOUR_TREE);
+    blob_coord_t run_start = 0;
+    blob_tree_t nesting;
+    /* Start of the scan, start of the current contour and total tracing time. */
+    uint64_t stats_start = 0, stats_t = 0, stats_trace = 0;
+
+    if(flags & (BLOB_COUNT_HOLES | BLOB_TWO_PASS))
+    {
+        return find_blobs_scan_runs(ctx, format, src, label, label_stride, roi_x, roi_y, roi_w, roi_h, flags, callback, user);
+    }
+
+    BLOB_STATS_TIME(stats_start);
+
+    BLOB_MEMSET(&scratch, 0, sizeof(contour_t));
+    current = 1;
+    class_src = *src;
+    class_src.lo = 0;
+    class_src.span = 0;
+    if(BLOB_FORMAT_CLASS == format)
+    {
+        pixel_src = &class_src;
+    }
+
+    line_label = label;
+    if(tree && !blob_tree_begin(ctx, &nesting, roi_w))
+    {
+        return 0;
+    }
+    
+    for(j=0; j<roi_h; j++, line_label+=label_stride)
+    {
+        last = -1;
+        run_label = 0;
+        if(tree)
+        {
+            blob_tree_row(&nesting);
+        }
+        /* Background pixels are skipped all at once. */
+        for(i=source_next(src, format, 0, j, roi_w); i<roi_w; i=source_next(src, format, i+1, j, roi_w))
+        {
+            ptr_label = line_label + i;
+            BLOB_STATS_ADD(ctx, pixels, 1);
+            if(BLOB_FORMAT_CLASS == format)
+            {
+                class_src.lo = src->data[(src->stride * j) + i];
+            }
+            if((last < 0) || (i != (last+1)) || (class_src.lo != run_class))
+            {
+                /* All the pixels of a run belong to the same blob. */
+                if(features && (last >= 0))
+                {
+                    blob_features_add_run(&ctx->blobs[run_label-1].features, roi_x + run_start, roi_y + j, last + 1 - run_start, second_order);
+                }
+                if(tree && (i > (last + 1)) && !blob_tree_run(ctx, &nesting, last + 1, i - 1, j, roi_w, roi_h))
+                {
+                    return 0;
+                }
+                run_start = i;
+                run_label = 0;
+                run_class = class_src.lo;
+            }
+            last = i;
+
+            /* The rows around a padded ROI can be read. */
+            const int padded = (BLOB_FORMAT_PADDED == format);
+            const int above_in = (padded || (j > 0)) ? source_get(pixel_src, format, i, j-1) : 0;
+            const int below_in = (padded || (j < (roi_h-1))) ? source_get(pixel_src, format, i, j+1) : 0;
+            /* 1. new external countour */
+            if((0 == *ptr_label) && (0 == above_in))
+            {
+                if(current == BLOB_LABEL_MAX)
+                {
+                    BLOB_ERROR("Too many blobs for label_t");
+                    return 0;
+                }
+                /* add new blob */
+                if( !blob_add(ctx) )
+                {
+                    return 0;
+                }
+                ctx->blobs[ctx->count-1].label = current;
+                ctx->blobs[ctx->count-1].x = roi_x + i;
+                ctx->blobs[ctx->count-1].y = roi_y + j;
+                ctx->blobs[ctx->count-1].cls = (BLOB_FORMAT_CLASS == format) ? class_src.lo : 1;
+                /* The background on the left of the blob surrounds it. It is
+                   replaced by the blob and the hole it belongs to at the end. */
+                if(tree)
+                {
+                    ctx->blobs[ctx->count-1].parent = nesting.current;
+                }
+                /* trace external contour */
+                contour_t *external = extract_external ? &ctx->blobs[ctx->count-1].external : NULL;
+                if(NULL != callback)
+                {
+                    contour_start(ctx, &scratch);
+                    external = extract_external ? &scratch : NULL;
+                }
+                BLOB_STATS_TIME(stats_t);
+                const int perimeter = contour_trace(ctx, format, pixel_src, 1, current, i, j, roi_x, roi_y, roi_w, roi_h, label, label_stride, external, mode);
+                if(!perimeter)
+                {
+                    return 0;
+                }
+                BLOB_STATS_ELAPSED(ctx, external_ns, stats_t, stats_trace);
+                BLOB_STATS_ADD(ctx, external_contours, 1);
+                ctx->blobs[ctx->count-1].features.perimeter = perimeter;
+                if(NULL != callback)
+                {
+                    if(perimeter >= ctx->min_perimeter)
+                    {
+                        contour_bind(ctx, &scratch, chain);
+                        if( !callback(&ctx->blobs[ctx->count-1], &scratch, 0, user) )
+                        {
+                            return 0;
+                        }
+                    }
+                    ctx->point_count = scratch.offset;
+                    ctx->code_count  = scratch.code_offset;
+                }
+                else if((perimeter < ctx->min_perimeter) && (NULL != external))
+                {
+                    /* The blob will be discarded, so its points are released now. */
+                    if(ctx->arena)
+                    {
+                        ctx->point_count = external->offset;
+                        ctx->code_count  = external->code_offset;
+                    }
+                    external->count = 0;
+                }
+                ++current;
+            }
+            /* The pixel below must be fetched after the external contour was traced as it
+               may have been marked. Note that a pixel starting an external contour can also
+               be on an internal contour. */
+            label_t below_label = -1;
+            if(padded || (j < (roi_h-1)))
+            {
+                below_label = (BLOB_FORMAT_CLASS == format) ? ctx->bits[i + ((ptrdiff_t)roi_w * (j+1))] : *(ptr_label + label_stride);
+            }
+            /* 2. new internal countour */
+            if((0 == below_in) && (0 == below_label))
+            {
+                /* If the current pixel was not labelled yet, it is an internal element
+                   and belongs to the same blob as the pixel on its left. */
+                label_t current_label = *ptr_label ? *ptr_label : run_label;
+                
+                /* add a new internal contour to the corresponding blob. */
+                blob_t *current_blob = ctx->blobs + (current_label-1);
+                contour_t *internal = NULL;
+                /* The holes of a blob that will be discarded are only counted. */
+                const int keep = (current_blob->features.perimeter >= ctx->min_perimeter);
+                if(NULL != callback)
+                {
+                    current_blob->internal_count++;
+                    contour_start(ctx, &scratch);
+                    internal = (extract_internal && keep) ? &scratch : NULL;
+                }
+                else if(extract_internal && keep)
+                {
+                    if( !blob_add_internal(ctx, current_blob) )
+                    {
+                        return 0;
+                    }
+                    internal = current_blob->internal + current_blob->internal_count - 1;
+                }
+                else
+                {
+                    /* even if we don't want to store the internal contours,
+                       we may want to know the number of holes. */
+                    current_blob->internal_count++;
+                }
+                /* The hole starts below the current pixel. */
+                if(tree && ((j + 1) < roi_h))
+                {
+                    blob_hole_t *hole = nesting.out + nesting.out_count++;
+                    hole->x    = i;
+                    hole->blob = current_label - 1;
+                    hole->hole = current_blob->internal_count - 1;
+                }
+
+                BLOB_STATS_TIME(stats_t);
+                if( !contour_trace(ctx, format, pixel_src, 0, current_label, i, j, roi_x, roi_y, roi_w, roi_h, label, label_stride, internal, mode) )
+                {
+                    return 0;
+                }
+                BLOB_STATS_ELAPSED(ctx, internal_ns, stats_t, stats_trace);
+                BLOB_STATS_ADD(ctx, internal_contours, 1);
+                if(NULL != callback)
+                {
+                    contour_bind(ctx, &scratch, chain);
+                    if(keep && !callback(current_blob, &scratch, 1, user))
+                    {
+                        return 0;
+                    }
+                    ctx->point_count = scratch.offset;
+                    ctx->code_count  = scratch.code_offset;
+                }
+            }
+            /* 3. internal element */
+            else if((0 == *ptr_label) && fill_labels)
+            {
+                *ptr_label = run_label;
+            }
+
+            if(*ptr_label)
+            {
+                run_label = *ptr_label;
+            }
+        }
+        if(features && (last >= 0))
+        {
+            blob_features_add_run(&ctx->blobs[run_label-1].features, roi_x + run_start, roi_y + j, last + 1 - run_start, second_order);
+        }
+        if(tree && ((last + 1) < roi_w) && !blob_tree_run(ctx, &nesting, last + 1, roi_w - 1, j, roi_w, roi_h))
+        {
+            return 0;
+        }
+    }
+    if(tree)
+    {
+        blob_tree_resolve(ctx, &nesting);
+    }
+    /* The holes of the blobs discarded by their perimeter were not stored. */
+    if( !blob_filter(ctx, label, label_stride, roi_w, roi_h, flags) )
+    {
+        return 0;
+    }
+    if(tree)
+    {
+        blob_tree_link(ctx);
+    }
+    contour_pool_bind(ctx, (NULL == callback) ? flags : (flags & ~BLOB_EXTRACT_INTERNAL));
+    BLOB_STATS_ADD(ctx, scan_ns, BLOB_STATS_NOW() - stats_start - stats_trace);
+    return 1;
+}
+
+/* Scan loops specialized for each input format. */
+static int find_blobs_scan_u8(blob_context_t *ctx, const blob_source_t *src, label_t *label, ptrdiff_t label_stride,
+                              blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                              int flags)
+{
+    return find_blobs_scan(ctx, BLOB_FORMAT_U8, src, label, label_stride, roi_x, roi_y, roi_w, roi_h, flags, NULL, NULL);
+}
+
+static int find_blobs_scan_bit(blob_context_t *ctx, const blob_source_t *src, label_t *label, ptrdiff_t label_stride,
+                               blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                               int flags)
+{
+    return find_blobs_scan(ctx, BLOB_FORMAT_BIT, src, label, label_stride, roi_x, roi_y, roi_w, roi_h, flags, NULL, NULL);
+}
+
+static int find_blobs_scan_range(blob_context_t *ctx, const blob_source_t *src, label_t *label, ptrdiff_t label_stride,
+                                 blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                                 int flags)
+{
+    return find_blobs_scan(ctx, BLOB_FORMAT_RANGE, src, label, label_stride, roi_x, roi_y, roi_w, roi_h, flags, NULL, NULL);
+}
+
+static int find_blobs_scan_class(blob_context_t *ctx, const blob_source_t *src, label_t *label, ptrdiff_t label_stride,
+                                 blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                                 int flags)
+{
+    return find_blobs_scan(ctx, BLOB_FORMAT_CLASS, src, label, label_stride, roi_x, roi_y, roi_w, roi_h, flags, NULL, NULL);
+}
+
+static int find_blobs_scan_padded(blob_context_t *ctx, const blob_source_t *src, label_t *label, ptrdiff_t label_stride,
+                                  blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                                  int flags)
+{
+    return find_blobs_scan(ctx, BLOB_FORMAT_PADDED, src, label, label_stride, roi_x, roi_y, roi_w, roi_h, flags, NULL, NULL);
+}
+
+static int find_blobs_scan_cb(blob_context_t *ctx, const blob_source_t *src, label_t *label, ptrdiff_t label_stride,
+                              blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                              int flags, blob_contour_callback_t callback, void *user)
+{
+    return find_blobs_scan(ctx, BLOB_FORMAT_U8, src, label, label_stride, roi_x, roi_y, roi_w, roi_h, flags, callback, user);
+}
+
+/* Compute connected components labels and contours using the buffers of a context. */
+int find_blobs_ctx(blob_context_t *ctx,
+                   blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                   uint8_t *in, blob_coord_t in_w, blob_coord_t in_h,
+                   int flags)
+{
+    blob_source_t src;
+
+    /* sanity check. */
+    if((NULL == ctx) || (NULL == in))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if( !find_blobs_prepare(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags, 1) )
+    {
+        return 0;
+    }
+    if(0 == roi_w)
+    {
+        return 1;
+    }
+
+    src.data   = in + roi_x + ((ptrdiff_t)in_w * roi_y);
+    src.stride = in_w;
+    src.x      = 0;
+    return find_blobs_scan_u8(ctx, &src, ctx->label, roi_w, roi_x, roi_y, roi_w, roi_h, flags);
+}
+
+/* Test if the 1 pixel border around the ROI is background. */
+static int find_blobs_border_check(const uint8_t *in, int in_stride,
+                                   blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h)
+{
+    const uint8_t *top    = in + (roi_x - 1) + ((ptrdiff_t)in_stride * (roi_y - 1));
+    const uint8_t *bottom = top + ((ptrdiff_t)in_stride * (roi_h + 1));
+    blob_coord_t i;
+    for(i=0; i<(roi_w+2); i++)
+    {
+        if(top[i] || bottom[i])
+        {
+            return 0;
+        }
+    }
+    for(i=1; i<=roi_h; i++)
+    {
+        if(top[(ptrdiff_t)in_stride * i] || top[((ptrdiff_t)in_stride * i) + roi_w + 1])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Compute connected components labels and contours of a padded image into
+   an optional caller owned label buffer. */
+int find_blobs_stride_ctx(blob_context_t *ctx,
+                          blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                          const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, int in_stride,
+                          label_t *label, int label_stride, int flags)
+{
+    blob_source_t src;
+    blob_coord_t j;
+    /* The ROI is labelled in the context buffer with its border, then the
+       rows are packed. */
+    int pack = 0;
+
+    /* sanity check. */
+    if((NULL == ctx) || (NULL == in))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if(0 == in_stride)
+    {
+        in_stride = in_w;
+    }
+    if(in_stride < in_w)
+    {
+        BLOB_ERROR("Invalid input stride");
+        return 0;
+    }
+    if(flags & BLOB_PADDED)
+    {
+        if((roi_w <= 0) || (roi_h <= 0) || (roi_x < 1) || (roi_y < 1) || ((roi_x + roi_w) >= in_w) || ((roi_y + roi_h) >= in_h))
+        {
+            BLOB_ERROR("The border of the ROI must be inside the image");
+            return 0;
+        }
+        if( !find_blobs_border_check(in, in_stride, roi_x, roi_y, roi_w, roi_h) )
+        {
+            BLOB_ERROR("The border of the ROI must be background");
+            return 0;
+        }
+    }
+    if((NULL == label) && (flags & BLOB_PADDED))
+    {
+        if( !find_blobs_clamp(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags)
+         || !blob_label_reserve(ctx, ((size_t)roi_w + 2) * ((size_t)roi_h + 2)) )
+        {
+            return 0;
+        }
+        label_stride = roi_w + 2;
+        label = ctx->label + label_stride + 1;
+        pack = 1;
+    }
+    else if(NULL == label)
+    {
+        if( !find_blobs_prepare(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags, 1) )
+        {
+            return 0;
+        }
+        label = ctx->label;
+        label_stride = roi_w;
+    }
+    else
+    {
+        if( !find_blobs_clamp(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags) )
+        {
+            return 0;
+        }
+        if((0 != roi_w) && (label_stride < roi_w))
+        {
+            BLOB_ERROR("Invalid label stride");
+            return 0;
+        }
+    }
+    if(0 == roi_w)
+    {
+        return 1;
+    }
+    if(flags & BLOB_PADDED)
+    {
+        /* The border below the last row must not be taken for a hole. */
+        BLOB_MEMSET(label - label_stride - 1, 0xff, ((size_t)roi_w + 2) * sizeof(label_t));
+        BLOB_MEMSET(label + ((ptrdiff_t)label_stride * roi_h) - 1, 0xff, ((size_t)roi_w + 2) * sizeof(label_t));
+        for(j=0; j<roi_h; j++)
+        {
+            label_t *line = label + ((ptrdiff_t)label_stride * j);
+            line[-1] = line[roi_w] = -1;
+        }
+    }
+    if(label != ctx->label)
+    {
+        /* only clear the labels of the ROI. */
+        for(j=0; j<roi_h; j++)
+        {
+            BLOB_MEMSET(label + ((ptrdiff_t)label_stride * j), 0, (size_t)roi_w * sizeof(label_t));
+        }
+    }
+
+    src.data   = in + roi_x + ((ptrdiff_t)in_stride * roi_y);
+    src.stride = in_stride;
+    src.x      = 0;
+    if(!(flags & BLOB_PADDED))
+    {
+        return find_blobs_scan_u8(ctx, &src, label, label_stride, roi_x, roi_y, roi_w, roi_h, flags);
+    }
+    if( !find_blobs_scan_padded(ctx, &src, label, label_stride, roi_x, roi_y, roi_w, roi_h, flags) )
+    {
+        return 0;
+    }
+    if(pack)
+    {
+        for(j=0; j<roi_h; j++)
+        {
+            memmove(ctx->label + ((ptrdiff_t)roi_w * j), label + ((ptrdiff_t)label_stride * j), (size_t)roi_w * sizeof(label_t));
+        }
+        ctx->label_w = roi_w;
+        ctx->label_h = roi_h;
+    }
+    return 1;
+}
+
+/* Compute connected components labels and contours of the pixels of a
+   grayscale image whose value is in [lo, hi]. */
+int find_blobs_range_ctx(blob_context_t *ctx,
+                         blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                         const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, int in_stride,
+                         uint8_t lo, uint8_t hi, int flags)
+{
+    blob_source_t src;
+
+    /* sanity check. */
+    if((NULL == ctx) || (NULL == in) || (lo > hi))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if(0 == in_stride)
+    {
+        in_stride = in_w;
+    }
+    if(in_stride < in_w)
+    {
+        BLOB_ERROR("Invalid input stride");
+        return 0;
+    }
+    if( !find_blobs_prepare(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags, 1) )
+    {
+        return 0;
+    }
+    if(0 == roi_w)
+    {
+        return 1;
+    }
+
+    src.data   = in + roi_x + ((ptrdiff_t)in_stride * roi_y);
+    src.stride = in_stride;
+    src.x      = 0;
+    src.lo     = lo;
+    src.span   = hi - lo;
+    return find_blobs_scan_range(ctx, &src, ctx->label, roi_w, roi_x, roi_y, roi_w, roi_h, flags);
+}
+
+/* Compute connected components labels and contours of each class of a
+   multi-class image. */
+int find_blobs_class_ctx(blob_context_t *ctx,
+                         blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                         const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, int in_stride,
+                         int flags)
+{
+    blob_source_t src;
+    size_t size;
+
+    /* sanity check. */
+    if((NULL == ctx) || (NULL == in))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if(0 == in_stride)
+    {
+        in_stride = in_w;
+    }
+    if(in_stride < in_w)
+    {
+        BLOB_ERROR("Invalid input stride");
+        return 0;
+    }
+    if(flags & BLOB_COUNT_HOLES)
+    {
+        BLOB_ERROR("Holes can not be counted in multi-class images");
+        return 0;
+    }
+    if(flags & BLOB_TWO_PASS)
+    {
+        BLOB_ERROR("Multi-class images require the contour tracing");
+        return 0;
+    }
+    if(flags & BLOB_CONTOUR_TREE)
+    {
+        BLOB_ERROR("The contour tree is not built for multi-class images");
+        return 0;
+    }
+    if( !find_blobs_prepare(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags, 1) )
+    {
+        return 0;
+    }
+    if(0 == roi_w)
+    {
+        return 1;
+    }
+    /* The pixels visited by the tracer are marked in a separate buffer. */
+    size = (size_t)roi_w * (size_t)roi_h;
+    if( !blob_bits_reserve(ctx, size) )
+    {
+        return 0;
+    }
+    BLOB_MEMSET(ctx->bits, 0, size);
+
+    src.data   = in + roi_x + ((ptrdiff_t)in_stride * roi_y);
+    src.stride = in_stride;
+    src.x      = 0;
+    src.lo     = 0;
+    src.span   = 0;
+    return find_blobs_scan_class(ctx, &src, ctx->label, roi_w, roi_x, roi_y, roi_w, roi_h, flags);
+}
+
+/* Compute connected components labels and pass each contour to a callback. */
+int find_blobs_cb(blob_context_t *ctx,
+                  blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                  uint8_t *in, blob_coord_t in_w, blob_coord_t in_h,
+                  int flags, blob_contour_callback_t callback, void *user)
+{
+    blob_source_t src;
+    int arena, ret;
+
+    /* sanity check. */
+    if((NULL == ctx) || (NULL == in) || (NULL == callback))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if(flags & BLOB_TWO_PASS)
+    {
+        BLOB_ERROR("The two-pass labelling does not trace contours");
+        return 0;
+    }
+    if(flags & BLOB_CONTOUR_TREE)
+    {
+        BLOB_ERROR("The contour tree is not built with a contour callback");
+        return 0;
+    }
+    if( !find_blobs_prepare(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags, 1) )
+    {
+        return 0;
+    }
+    if(0 == roi_w)
+    {
+        return 1;
+    }
+
+    src.data   = in + roi_x + ((ptrdiff_t)in_w * roi_y);
+    src.stride = in_w;
+    src.x      = 0;
+    /* The contours are traced in the pool, and discarded after the callback. */
+    arena = ctx->arena;
+    ctx->arena = 1;
+    ret = find_blobs_scan_cb(ctx, &src, ctx->label, roi_w, roi_x, roi_y, roi_w, roi_h, flags, callback, user);
+    ctx->arena = arena;
+    return ret;
+}
+
+/* Compute connected components labels and contours of a 1bpp image. */
+int find_blobs_1bpp_ctx(blob_context_t *ctx,
+                        blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                        const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, int in_stride,
+                        int flags)
+{
+    blob_source_t src;
+
+    /* sanity check. */
+    if((NULL == ctx) || (NULL == in) || ((in_stride > 0) && (in_stride < ((in_w + 7) / 8))))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if( !find_blobs_prepare(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags, 1) )
+    {
+        return 0;
+    }
+    if(0 == roi_w)
+    {
+        return 1;
+    }
+
+    src.stride = (in_stride > 0) ? in_stride : ((in_w + 7) / 8);
+    src.data   = in + (src.stride * roi_y);
+    src.x      = roi_x;
+    return find_blobs_scan_bit(ctx, &src, ctx->label, roi_w, roi_x, roi_y, roi_w, roi_h, flags);
+}
+
+/* Compute connected components labels and contours of a run-length encoded image. */
+int find_blobs_rle_ctx(blob_context_t *ctx,
+                       blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                       const blob_run_t *runs, const int *rows, blob_coord_t in_w, blob_coord_t in_h,
+                       int flags)
+{
+    blob_source_t src;
+    size_t size;
+    blob_coord_t j;
+
+    /* sanity check. */
+    if((NULL == ctx) || (NULL == runs) || (NULL == rows))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if( !find_blobs_prepare(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags, 1) )
+    {
+        return 0;
+    }
+    if(0 == roi_w)
+    {
+        return 1;
+    }
+
+    /* Expand the runs overlapping the ROI into a 1bpp bitmap. */
+    src.stride = (roi_w + 7) / 8;
+    src.x      = 0;
+    size = (size_t)src.stride * (size_t)roi_h;
+    if( !blob_bits_reserve(ctx, size) )
+    {
+        return 0;
+    }
+    BLOB_MEMSET(ctx->bits, 0, size);
+
+    for(j=0; j<roi_h; j++)
+    {
+        uint8_t *line = ctx->bits + (src.stride * j);
+        int k;
+        for(k=rows[roi_y+j]; k<rows[roi_y+j+1]; k++)
+        {
+            ptrdiff_t start = runs[k].x - roi_x;
+            ptrdiff_t end   = start + runs[k].length;
+            if(start < 0)     { start = 0; }
+            if(end   > roi_w) { end = roi_w; }
+            /* Leading bits, whole bytes and trailing bits. */
+            for(; (start < end) && (start & 7); start++)
+            {
+                line[start >> 3] |= 0x80 >> (start & 7);
+            }
+            if((end - start) >= 8)
+            {
+                BLOB_MEMSET(line + (start >> 3), 0xff, (end - start) >> 3);
+                start += (end - start) & ~7L;
+            }
+            for(; start < end; start++)
+            {
+                line[start >> 3] |= 0x80 >> (start & 7);
+            }
+        }
+    }
+
+    src.data = ctx->bits;
+    return find_blobs_scan_bit(ctx, &src, ctx->label, roi_w, roi_x, roi_y, roi_w, roi_h, flags);
+}
+
+#if !defined(BLOB_MIN_STRIP_ROWS)
+#define BLOB_MIN_STRIP_ROWS 32
+#endif
+
+/* Grow the array of per strip contexts. */
+static int blob_workers_reserve(blob_context_t *ctx, int count)
+{
+    blob_context_t *tmp;
+    int i;
+    if(count <= ctx->worker_count)
+    {
+        return 1;
+    }
+    tmp = (blob_context_t*)BLOB_REALLOC(ctx->workers, count * sizeof(blob_context_t));
+    if(NULL == tmp)
+    {
+        BLOB_ERROR("Out of memory");
+        return 0;
+    }
+    for(i=ctx->worker_count; i<count; i++)
+    {
+        blob_context_init(tmp + i);
+    }
+    ctx->workers = tmp;
+    ctx->worker_count = count;
+    return 1;
+}
+
+/* Copy the points or the chain codes of a contour. Chain codes are only
+   stored in arena mode. */
+static int contour_copy(blob_context_t *ctx, contour_t *dst, const contour_t *src)
+{
+    blob_coord_t *ptr;
+    /* Only the first point is stored with chain codes. */
+    const int count = (NULL != src->codes) ? 1 : src->count;
+    if(0 == src->count)
+    {
+        return 1;
+    }
+    if(NULL != src->codes)
+    {
+        const size_t size = ((3 * (size_t)(src->count - 1)) + 7) >> 3;
+        const size_t needed = ctx->code_count + size;
+        if(needed > ctx->code_capacity)
+        {
+            size_t capacity = ctx->code_capacity ? (ctx->code_capacity * 2) : 1024;
+            if(capacity < needed) { capacity = needed; }
+            if( !contour_code_reserve(ctx, capacity) )
+            {
+                return 0;
+            }
+        }
+        memcpy(ctx->codes + ctx->code_count, src->codes, size);
+        ctx->code_count = needed;
+    }
+    if(ctx->arena)
+    {
+        const size_t needed = ctx->point_count + (size_t)count;
+        if(needed > ctx->point_capacity)
+        {
+            size_t capacity = ctx->point_capacity ? (ctx->point_capacity * 2) : 1024;
+            if(capacity < needed) { capacity = needed; }
+            if( !contour_pool_reserve(ctx, capacity) )
+            {
+                return 0;
+            }
+        }
+        ptr = ctx->points + (ctx->point_count * 2);
+        ctx->point_count = needed;
+    }
+    else
+    {
+        if(count > dst->capacity)
+        {
+            blob_coord_t *tmp = (blob_coord_t*)BLOB_REALLOC(dst->points, count * (2 * sizeof(blob_coord_t)));
+            if(NULL == tmp)
+            {
+                BLOB_ERROR("Out of memory");
+                return 0;
+            }
+            BLOB_STATS_ADD(ctx, contour_reallocs, 1);
+            BLOB_STATS_ADD(ctx, contour_bytes, count * (2 * sizeof(blob_coord_t)));
+            dst->points = tmp;
+            dst->capacity = count;
+        }
+        ptr = dst->points;
+    }
+    memcpy(ptr, src->points, count * (2 * sizeof(blob_coord_t)));
+    dst->count = src->count;
+    return 1;
+}
+
+/* Append a copy of a blob found by another context. */
+static int blob_copy(blob_context_t *ctx, const blob_t *src, int flags, label_t label)
+{
+    blob_t *b;
+    int j;
+    if( !blob_add(ctx) )
+    {
+        return 0;
+    }
+    b = ctx->blobs + (ctx->count - 1);
+    b->label = label;
+    b->x = src->x;
+    b->cls = src->cls;
+    b->y = src->y;
+    if( !contour_copy(ctx, &b->external, &src->external) )
+    {
+        return 0;
+    }
+    if(flags & BLOB_EXTRACT_INTERNAL)
+    {
+        for(j=0; j<src->internal_count; j++)
+        {
+            if( !blob_add_internal(ctx, b) || !contour_copy(ctx, b->internal + j, src->internal + j) )
+            {
+                return 0;
+            }
+        }
+    }
+    else
+    {
+        b->internal_count = src->internal_count;
+    }
+    if(flags & (BLOB_FEATURES | BLOB_SECOND_ORDER))
+    {
+        b->features = src->features;
+    }
+    else
+    {
+        b->features.perimeter = src->features.perimeter;
+    }
+    if(flags & BLOB_CONTOUR_TREE)
+    {
+        /* The indices are relative to the first blob of the same call. */
+        b->parent  = src->parent;
+        b->hole    = src->hole;
+        b->child   = src->child;
+        b->sibling = src->sibling;
+    }
+    return 1;
+}
+
+/* Union-find with the smallest index as the root of each set. */
+static int blob_uf_find(int *parent, int i)
+{
+    while(parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static void blob_uf_union(int *parent, int a, int b)
+{
+    a = blob_uf_find(parent, a);
+    b = blob_uf_find(parent, b);
+    if(a < b)      { parent[b] = a; }
+    else if(b < a) { parent[a] = b; }
+}
+
+/* Multi-threaded labelling.
+   1. The runs of foreground pixels of each strip are merged with the
+      8-connected runs of the previous row, concurrently. This gives the
+      rows spanned by the blobs of the strip touching its boundaries.
+   2. These rows, and the rows above and below them as their contours mark
+      them, make up the bands which will be traced again. A blob spanning
+      several strips is covered by the rows of its parts, which overlap
+      around each boundary. If the bands cover at least half of the ROI,
+      the whole ROI is labelled by the calling thread instead, before any
+      contour is traced.
+   3. The strips are labelled concurrently, each one by its own worker
+      context, directly into the rows of the label buffer. The contours and
+      marks of the blobs touching a strip boundary are not reliable.
+   4. The pixels of these blobs are copied to their band. The bands are
+      labelled concurrently by their own worker contexts.
+   5. The blobs of the strips and of the bands are merged in raster order.
+   6. The label buffer is renumbered, and the bands results are copied
+      back. */
+
+/* Run of foreground pixels of a strip. */
+typedef struct
+{
+    blob_coord_t x0, x1;
+    /* Row in the ROI. */
+    int y;
+    /* Set of the runs (the index of its first run is the root). */
+    int parent;
+    /* Last row of the set (only meaningful for its root). */
+    int last;
+} blob_mt_run_t;
+
+typedef struct
+{
+    blob_context_t *ctx;
+    /* First pixel of the ROI. */
+    const uint8_t *in;
+    ptrdiff_t in_stride;
+    blob_coord_t roi_x, roi_y, roi_w, roi_h;
+    int flags;
+    int strips;
+    /* First row of each strip (strips+1 entries). */
+    int *rows;
+    /* Last row to trace again below the first row of each strip, or -1,
+       and first row to trace again above its last row, or roi_h. */
+    int *cover;
+    /* First and last rows of each band. */
+    int *bands;
+    /* Band index of each row or -1. */
+    int *band_of_row;
+    /* Result of each task. */
+    int *status;
+} blob_mt_job_t;
+
+/* Carve the arrays of a job from the context temporary buffer. */
+static int find_blobs_mt_bind(blob_mt_job_t *job)
+{
+    const int strips = job->strips;
+    const size_t count = (size_t)(strips + 1) + (size_t)(2 * strips) + (size_t)(2 * strips) + (size_t)job->roi_h + (size_t)strips;
+    if( !blob_scratch_reserve(job->ctx, count * sizeof(int)) )
+    {
+        return 0;
+    }
+    job->rows        = (int*)job->ctx->scratch;
+    job->cover       = job->rows + (strips + 1);
+    job->bands       = job->cover + (2 * strips);
+    job->band_of_row = job->bands + (2 * strips);
+    job->status      = job->band_of_row + job->roi_h;
+    return 1;
+}
+
+static int blob_mt_run_find(blob_mt_run_t *runs, int i)
+{
+    while(runs[i].parent != i)
+    {
+        runs[i].parent = runs[runs[i].parent].parent;
+        i = runs[i].parent;
+    }
+    return i;
+}
+
+/* 1. Merge the runs of a strip, and find the rows spanned by its sets of
+   runs touching its first or last row. The runs are stored in the scratch
+   buffer of its worker context. */
+static void find_blobs_mt_runs(void *arg, int k)
+{
+    blob_mt_job_t *job = (blob_mt_job_t*)arg;
+    blob_context_t *w = job->ctx->workers + k;
+    blob_mt_run_t *runs = (blob_mt_run_t*)w->scratch;
+    size_t capacity = w->scratch_capacity / sizeof(blob_mt_run_t);
+    const blob_coord_t roi_w = job->roi_w;
+    blob_source_t src;
+    blob_coord_t i, x0;
+    int count = 0, previous = 0, first = 0, first_row = 0;
+    int j, l;
+
+    src.data   = job->in;
+    src.stride = job->in_stride;
+    src.x      = 0;
+    job->status[k] = 0;
+    for(j=job->rows[k]; j<job->rows[k+1]; j++)
+    {
+        first = count;
+        for(i=source_next(&src, BLOB_FORMAT_U8, 0, j, roi_w); i<roi_w; i=source_next(&src, BLOB_FORMAT_U8, i+1, j, roi_w))
+        {
+            x0 = i;
+            while(((i+1) < roi_w) && source_get(&src, BLOB_FORMAT_U8, i+1, j))
+            {
+                i++;
+            }
+            if((size_t)count == capacity)
+            {
+                capacity = capacity ? (capacity * 2) : 1024;
+                if( !blob_scratch_reserve(w, capacity * sizeof(blob_mt_run_t)) )
+                {
+                    return;
+                }
+                runs = (blob_mt_run_t*)w->scratch;
+            }
+            runs[count].x0 = x0;
+            runs[count].x1 = i;
+            runs[count].y = j;
+            runs[count].parent = count;
+            runs[count].last = j;
+            /* The runs of the previous row ending before x0-1 can not touch
+               this run, nor the next ones. */
+            while((previous < first) && (runs[previous].x1 < (x0 - 1)))
+            {
+                previous++;
+            }
+            for(l=previous; (l<first) && (runs[l].x0 <= (i + 1)); l++)
+            {
+                const int a = blob_mt_run_find(runs, l);
+                const int b = blob_mt_run_find(runs, count);
+                if(a < b)      { runs[b].parent = a; runs[a].last = j; }
+                else if(b < a) { runs[a].parent = b; runs[b].last = j; }
+            }
+            count++;
+        }
+        previous = first;
+        if(j == job->rows[k])
+        {
+            first_row = count;
+        }
+    }
+
+    /* The first run of a set gives its first row. The rows above and below
+       a set are traced again too, as its contours mark them. */
+    job->cover[2*k]   = -1;
+    job->cover[2*k+1] = job->roi_h;
+    for(l=0; (k > 0) && (l < first_row); l++)
+    {
+        const int r = blob_mt_run_find(runs, l);
+        const int last = (runs[r].last < (job->roi_h - 1)) ? (runs[r].last + 1) : runs[r].last;
+        if(last > job->cover[2*k])
+        {
+            job->cover[2*k] = last;
+        }
+    }
+    for(l=first; (k < (job->strips-1)) && (l < count); l++)
+    {
+        const int r = blob_mt_run_find(runs, l);
+        const int top = (runs[r].y > 0) ? (runs[r].y - 1) : 0;
+        if(top < job->cover[2*k+1])
+        {
+            job->cover[2*k+1] = top;
+        }
+    }
+    job->status[k] = 1;
+}
+
+/* 2. Gather the rows to trace again into bands. Each band holds at least
+   one strip boundary, so there are less bands than strips. Return the
+   number of rows they cover. */
+static int find_blobs_mt_bands(blob_mt_job_t *job, int *bands)
+{
+    const int strips = job->strips;
+    int covered, count, i, k;
+
+    for(i=0; i<job->roi_h; i++)
+    {
+        job->band_of_row[i] = -1;
+    }
+    /* The intervals are sorted by first row. */
+    for(count=0, covered=0, k=1; k<(2*strips - 1); k++)
+    {
+        const int s = k / 2;
+        int first, last;
+        if(k & 1)
+        {
+            first = job->cover[2*s+1];
+            last  = job->rows[s+1];
+        }
+        else
+        {
+            first = job->rows[s] - 1;
+            last  = job->cover[2*s];
+        }
+        if(first > last)
+        {
+            continue;
+        }
+        if((count > 0) && (first <= job->bands[2*count-1]))
+        {
+            first = job->bands[2*count-1] + 1;
+            if(last > job->bands[2*count-1])
+            {
+                job->bands[2*count-1] = last;
+            }
+        }
+        else
+        {
+            job->bands[2*count]   = first;
+            job->bands[2*count+1] = last;
+            count++;
+        }
+        for(i=first; i<=last; i++)
+        {
+            job->band_of_row[i] = count - 1;
+            covered++;
+        }
+    }
+    *bands = count;
+    return covered;
+}
+
+/* 3. Label a strip. */
+static void find_blobs_mt_strip(void *arg, int k)
+{
+    blob_mt_job_t *job = (blob_mt_job_t*)arg;
+    blob_context_t *w = job->ctx->workers + k;
+    const int y = job->rows[k];
+    const blob_coord_t h = (blob_coord_t)(job->rows[k+1] - y);
+    label_t *label = job->ctx->label + ((ptrdiff_t)job->roi_w * y);
+    blob_source_t src;
+
+    /* The strips are not filtered, the merged blobs are. The worker may
+       still hold the filters of a batch. */
+    blob_context_reset(w);
+    w->min_perimeter = 0;
+    w->min_area = 0;
+    BLOB_MEMSET(label, 0, (size_t)job->roi_w * (size_t)h * sizeof(label_t));
+
+    src.data   = job->in + (job->in_stride * y);
+    src.stride = job->in_stride;
+    src.x      = 0;
+    /* The bounding boxes tell which blobs touch the strip boundaries. */
+    job->status[k] = find_blobs_scan_u8(w, &src, label, job->roi_w, job->roi_x, job->roi_y + y, job->roi_w, h, job->flags | BLOB_FEATURES);
+}
+
+/* 4. Label the blobs of a band which must be traced again. */
+static void find_blobs_mt_band(void *arg, int i)
+{
+    blob_mt_job_t *job = (blob_mt_job_t*)arg;
+    blob_context_t *ctx = job->ctx;
+    blob_context_t *w = ctx->workers + job->strips + i;
+    const int first = job->bands[2*i];
+    const int last  = job->bands[2*i+1];
+    const blob_coord_t roi_w = job->roi_w;
+    const blob_coord_t h = (blob_coord_t)(last + 1 - first);
+    const size_t count = (size_t)roi_w * (size_t)h;
+    blob_source_t src;
+    int k, y;
+
+    blob_context_reset(w);
+    w->min_perimeter = 0;
+    w->min_area = 0;
+    if( !blob_label_reserve(w, count) || !blob_bits_reserve(w, count) )
+    {
+        job->status[i] = 0;
+        return;
+    }
+    BLOB_MEMSET(w->label, 0, count * sizeof(label_t));
+
+    /* Only keep the pixels of the blobs traced again. The other blobs of the
+       band do not change their contours, holes or labels. */
+    for(k=0, y=first; y<=last; y++)
+    {
+        const uint8_t *in = job->in + (job->in_stride * y);
+        const label_t *label = ctx->label + ((ptrdiff_t)roi_w * y);
+        uint8_t *out = w->bits + ((ptrdiff_t)roi_w * (y - first));
+        const blob_t *blobs;
+        label_t run_label = 0;
+        blob_coord_t x;
+        while(y >= job->rows[k+1])
+        {
+            k++;
+        }
+        blobs = ctx->workers[k].blobs;
+        for(x=0; x<roi_w; x++)
+        {
+            if(0 == in[x])
+            {
+                run_label = 0;
+            }
+            else if(label[x] > 0)
+            {
+                run_label = label[x];
+            }
+            out[x] = (run_label > 0) && (0 == blobs[run_label-1].label);
+        }
+    }
+
+    src.data   = w->bits;
+    src.stride = roi_w;
+    src.x      = 0;
+    job->status[i] = find_blobs_scan_u8(w, &src, w->label, roi_w, job->roi_x, job->roi_y + first, roi_w, h, job->flags);
+}
+
+/* 6. Renumber the labels of a strip. */
+static void find_blobs_mt_relabel(void *arg, int k)
+{
+    blob_mt_job_t *job = (blob_mt_job_t*)arg;
+    blob_context_t *ctx = job->ctx;
+    const blob_coord_t roi_w = job->roi_w;
+    const blob_t *blobs = ctx->workers[k].blobs;
+    blob_coord_t x;
+    int y;
+
+    for(y=job->rows[k]; y<job->rows[k+1]; y++)
+    {
+        label_t *label = ctx->label + ((ptrdiff_t)roi_w * y);
+        const int band = job->band_of_row[y];
+        if(band < 0)
+        {
+            for(x=0; x<roi_w; x++)
+            {
+                if(label[x] > 0)
+                {
+                    label[x] = blobs[label[x]-1].label;
+                }
+            }
+        }
+        else
+        {
+            const blob_context_t *w = ctx->workers + job->strips + band;
+            const label_t *traced = w->label + ((ptrdiff_t)roi_w * (y - job->bands[2*band]));
+            const uint8_t *in = job->in + (job->in_stride * y);
+            for(x=0; x<roi_w; x++)
+            {
+                if(traced[x] > 0)
+                {
+                    label[x] = w->blobs[traced[x]-1].label;
+                }
+                else if(label[x] > 0)
+                {
+                    /* 0 if the blob was traced again. */
+                    label[x] = blobs[label[x]-1].label;
+                }
+                else if((label[x] < 0) || (traced[x] < 0))
+                {
+                    label[x] = in[x] ? 0 : -1;
+                }
+            }
+        }
+    }
+}
+
+/* Compute connected components labels and contours on several threads. */
+int find_blobs_mt_ctx(blob_context_t *ctx,
+                      blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                      uint8_t *in, blob_coord_t in_w, blob_coord_t in_h,
+                      int flags, int threads)
+{
+    blob_mt_job_t job;
+    blob_source_t src;
+    int strips, bands, total, i, k, l, g;
+    size_t points;
+
+    /* sanity check. */
+    if((NULL == ctx) || (NULL == in))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if( !find_blobs_prepare(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags, 0) )
+    {
+        return 0;
+    }
+    if(0 == roi_w)
+    {
+        return 1;
+    }
+    /* The strips are not filtered, the merged blobs are. */
+    if(ctx->min_area > 0)
+    {
+        flags |= BLOB_FEATURES;
+    }
+
+    src.data   = in + roi_x + ((ptrdiff_t)in_w * roi_y);
+    src.stride = in_w;
+    src.x      = 0;
+
+    strips = threads;
+    if(strips > (roi_h / BLOB_MIN_STRIP_ROWS))
+    {
+        strips = roi_h / BLOB_MIN_STRIP_ROWS;
+    }
+    /* The strips are merged by tracing contours again. The nesting of the
+       blobs is only known by a scan of the whole ROI. */
+    if((strips <= 1) || (flags & (BLOB_TWO_PASS | BLOB_CONTOUR_TREE)))
+    {
+        BLOB_MEMSET(ctx->label, 0, (size_t)roi_w * (size_t)roi_h * sizeof(label_t));
+        return find_blobs_scan_u8(ctx, &src, ctx->label, roi_w, roi_x, roi_y, roi_w, roi_h, flags);
+    }
+
+    /* One worker context per strip and per strip boundary. */
+    if( !blob_workers_reserve(ctx, (2 * strips) - 1) )
+    {
+        return 0;
+    }
+
+    job.ctx       = ctx;
+    job.in        = src.data;
+    job.in_stride = src.stride;
+    job.roi_x     = roi_x;
+    job.roi_y     = roi_y;
+    job.roi_w     = roi_w;
+    job.roi_h     = roi_h;
+    job.flags     = flags;
+    job.strips    = strips;
+    if( !find_blobs_mt_bind(&job) )
+    {
+        return 0;
+    }
+
+    /* 1. Merge the runs of the strips. */
+    for(k=0; k<=strips; k++)
+    {
+        job.rows[k] = (int)(((int64_t)roi_h * k) / strips);
+    }
+    blob_parallel_run(find_blobs_mt_runs, &job, strips);
+    for(k=0; k<strips; k++)
+    {
+        if(!job.status[k])
+        {
+            return 0;
+        }
+    }
+
+    /* 2. Find the bands. Tracing them again costs as much as a single
+       thread scan of their rows, plus a copy and a relabelling pass. When
+       they cover most of the ROI, the whole ROI is scanned at once. */
+    if((2 * find_blobs_mt_bands(&job, &bands)) >= roi_h)
+    {
+        BLOB_MEMSET(ctx->label, 0, (size_t)roi_w * (size_t)roi_h * sizeof(label_t));
+        return find_blobs_scan_u8(ctx, &src, ctx->label, roi_w, roi_x, roi_y, roi_w, roi_h, flags);
+    }
+
+    /* 3. Label the strips. The blobs touching a strip boundary get label 0
+       until they are traced again. */
+    blob_parallel_run(find_blobs_mt_strip, &job, strips);
+    for(k=0; k<strips; k++)
+    {
+        if(!job.status[k])
+        {
+            return 0;
+        }
+    }
+    for(k=0; k<strips; k++)
+    {
+        const int first = job.rows[k];
+        const int last  = job.rows[k+1] - 1;
+        for(l=0; l<ctx->workers[k].count; l++)
+        {
+            blob_t *b = ctx->workers[k].blobs + l;
+            if(((k > 0) && ((b->features.min_y - roi_y) == first)) || ((k < (strips-1)) && ((b->features.max_y - roi_y) == last)))
+            {
+                b->label = 0;
+            }
+        }
+    }
+
+    /* 4. Trace the blobs of the bands again. */
+    blob_parallel_run(find_blobs_mt_band, &job, bands);
+    for(k=0; k<bands; k++)
+    {
+        if(!job.status[k])
+        {
+            return 0;
+        }
+    }
+
+    /* 5. Merge the blobs in raster order of their first pixel. */
+    for(total=0, points=0, k=0; k<(strips+bands); k++)
+    {
+        total  += ctx->workers[k].count;
+        points += ctx->workers[k].point_count;
+    }
+    if( !blob_reserve(ctx, total) || (ctx->arena && !contour_pool_reserve(ctx, points)) )
+    {
+        return 0;
+    }
+    for(k=0, l=0, i=0, g=0; ; )
+    {
+        blob_t *a = NULL;
+        blob_t *b = NULL;
+        while(k < strips)
+        {
+            if(l >= ctx->workers[k].count)
+            {
+                k++;
+                l = 0;
+            }
+            else if(0 == ctx->workers[k].blobs[l].label)
+            {
+                l++;
+            }
+            else
+            {
+                a = ctx->workers[k].blobs + l;
+                break;
+            }
+        }
+        while((i < bands) && (g >= ctx->workers[strips+i].count))
+        {
+            i++;
+            g = 0;
+        }
+        if(i < bands)
+        {
+            b = ctx->workers[strips+i].blobs + g;
+        }
+        if((NULL != a) && ((NULL == b) || (a->y < b->y) || ((a->y == b->y) && (a->x < b->x))))
+        {
+            l++;
+        }
+        else if(NULL != b)
+        {
+            a = b;
+            g++;
+        }
+        else
+        {
+            break;
+        }
+        if((ctx->count + 1) >= BLOB_LABEL_MAX)
+        {
+            BLOB_ERROR("Too many blobs for label_t");
+            return 0;
+        }
+        if( !blob_copy(ctx, a, flags, (label_t)(ctx->count + 1)) )
+        {
+            return 0;
+        }
+        /* The worker label now gives the final label. */
+        a->label = (label_t)ctx->count;
+    }
+    contour_pool_bind(ctx, flags);
+
+    /* 6. Renumber the label buffer. */
+    blob_parallel_run(find_blobs_mt_relabel, &job, strips);
+    for(i=0; i<ctx->worker_count; i++)
+    {
+        blob_stats_move(&ctx->stats, &ctx->workers[i].stats);
+    }
+    return blob_filter(ctx, ctx->label, roi_w, roi_w, roi_h, flags);
+}
+
+/* Batch processing.
+   Each thread labels jobs with its scan context. The scan context borrows
+   the blob array and the contour pools of the output context of the job,
+   so the blobs are traced where they are kept. */
+typedef struct
+{
+    blob_context_t *ctx;
+    blob_job_t *jobs;
+    int count;
+    int flags;
+    int threads;
+    /* Index of the next job. */
+    volatile long next;
+} blob_batch_t;
+
+/* Swap the blobs and the contour pools of 2 contexts. */
+static void blob_output_swap(blob_context_t *a, blob_context_t *b)
+{
+    blob_context_t tmp = *a;
+    a->blobs          = b->blobs;
+    a->count          = b->count;
+    a->capacity       = b->capacity;
+    a->points         = b->points;
+    a->point_count    = b->point_count;
+    a->point_capacity = b->point_capacity;
+    a->codes          = b->codes;
+    a->code_count     = b->code_count;
+    a->code_capacity  = b->code_capacity;
+    b->blobs          = tmp.blobs;
+    b->count          = tmp.count;
+    b->capacity       = tmp.capacity;
+    b->points         = tmp.points;
+    b->point_count    = tmp.point_count;
+    b->point_capacity = tmp.point_capacity;
+    b->codes          = tmp.codes;
+    b->code_count     = tmp.code_count;
+    b->code_capacity  = tmp.code_capacity;
+}
+
+static void find_blobs_batch_run(void *arg, int t)
+{
+    blob_batch_t *batch = (blob_batch_t*)arg;
+    blob_context_t *scan = batch->ctx->workers + t;
+    int i;
+
+    while((i = blob_fetch_add(&batch->next)) < batch->count)
+    {
+        blob_job_t *job = batch->jobs + i;
+        blob_context_t *out = batch->ctx->workers + batch->threads + i;
+        blob_output_swap(scan, out);
+        job->status = find_blobs_ctx(scan, job->roi_x, job->roi_y, job->roi_w, job->roi_h, job->in, job->in_w, job->in_h, batch->flags);
+        blob_output_swap(scan, out);
+        blob_stats_move(&out->stats, &scan->stats);
+        if( !job->status )
+        {
+            blob_context_reset(out);
+        }
+        job->count = out->count;
+        job->blobs = out->count ? out->blobs : NULL;
+    }
+}
+
+/* Compute connected components and contours of many images on several threads. */
+int find_blobs_batch_ctx(blob_context_t *ctx, blob_job_t *jobs, int count, int flags, int threads)
+{
+    blob_batch_t batch;
+    int i, ret;
+
+    /* sanity check. */
+    if((NULL == ctx) || ((NULL == jobs) && (count > 0)))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if(count <= 0)
+    {
+        return 1;
+    }
+    if(threads > count) { threads = count; }
+    if(threads < 1)     { threads = 1; }
+
+    /* One scan context per thread, then one output context per job. */
+    if( !blob_workers_reserve(ctx, threads + count) )
+    {
+        return 0;
+    }
+
+    batch.ctx     = ctx;
+    batch.jobs    = jobs;
+    batch.count   = count;
+    batch.flags   = flags;
+    batch.threads = threads;
+    batch.next    = 0;
+    BLOB_MEMSET(&ctx->stats, 0, sizeof(blob_stats_t));
+    for(i=0; i<threads; i++)
+    {
+        ctx->workers[i].min_perimeter = ctx->min_perimeter;
+        ctx->workers[i].min_area      = ctx->min_area;
+    }
+    blob_parallel_run(find_blobs_batch_run, &batch, threads);
+    for(i=0; i<ctx->worker_count; i++)
+    {
+        blob_stats_move(&ctx->stats, &ctx->workers[i].stats);
+    }
+
+    for(ret=1, i=0; i<count; i++)
+    {
+        ret = ret && jobs[i].status;
+    }
+    return ret;
+}
+
+/* Incremental labelling.
+   1. The dirty rectangles, grown by 1 pixel, are grouped with the blobs of
+      the previous frame they touch. Rectangles sharing a blob, or close
+      enough for a new blob to span both, end up in the same group.
+   2. The blobs of the groups are removed.
+   3. The pixels of a group which may belong to a new blob (the foreground
+      pixels of its rectangles and the pixels of its removed blobs) are
+      copied to a bitmap covering the group, and their labels are cleared.
+      The bitmap is labelled by a worker context, whose blobs and labels
+      are copied back. The new blobs only get labels which were not used
+      by the previous frame, so that they can not be taken for the removed
+      blobs of the next groups. */
+
+/* Label the whole ROI and keep its results for the next incremental call. */
+static int find_blobs_update_all(blob_context_t *ctx,
+                                 blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                                 const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h,
+                                 int flags)
+{
+    blob_source_t src;
+    if( !find_blobs_prepare(ctx, &roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h, flags, 1) )
+    {
+        return 0;
+    }
+    if(0 == roi_w)
+    {
+        return 1;
+    }
+    src.data   = in + roi_x + ((ptrdiff_t)in_w * roi_y);
+    src.stride = in_w;
+    src.x      = 0;
+    if( !find_blobs_scan_u8(ctx, &src, ctx->label, roi_w, roi_x, roi_y, roi_w, roi_h, flags) )
+    {
+        return 0;
+    }
+    ctx->update_x = roi_x;
+    ctx->update_y = roi_y;
+    ctx->update_flags = flags;
+    return 1;
+}
+
+/* Clamp a rectangle grown by n pixels to the ROI. The corners of the
+   result are stored in ROI coordinates (inclusive). Return 0 if the
+   rectangle itself does not intersect the ROI. */
+static int blob_rect_clamp(const blob_rect_t *rect, int n,
+                           blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                           int *box)
+{
+    const int x0 = rect->x - roi_x;
+    const int y0 = rect->y - roi_y;
+    const int x1 = x0 + rect->w - 1;
+    const int y1 = y0 + rect->h - 1;
+    if((x1 < 0) || (y1 < 0) || (x0 >= roi_w) || (y0 >= roi_h) || (x0 > x1) || (y0 > y1))
+    {
+        return 0;
+    }
+    box[0] = ((x0 - n) < 0) ? 0 : (x0 - n);
+    box[1] = ((y0 - n) < 0) ? 0 : (y0 - n);
+    box[2] = ((x1 + n) >= roi_w) ? (roi_w - 1) : (x1 + n);
+    box[3] = ((y1 + n) >= roi_h) ? (roi_h - 1) : (y1 + n);
+    return 1;
+}
+
+/* Grow a box so that it contains another one. */
+static void blob_box_add(int *box, int x0, int y0, int x1, int y1)
+{
+    if(x0 < box[0]) { box[0] = x0; }
+    if(y0 < box[1]) { box[1] = y0; }
+    if(x1 > box[2]) { box[2] = x1; }
+    if(y1 > box[3]) { box[3] = y1; }
+}
+
+/* Move the stored contours of the blobs to pools without the contours of
+   the removed blobs (arena mode), once these take most of the pools. */
+static int contour_pool_compact(blob_context_t *ctx, int flags)
+{
+    const int chain = flags & BLOB_CHAIN_CODES;
+    const int contours = (flags & BLOB_EXTRACT_INTERNAL) ? 1 : 0;
+    blob_coord_t *points = NULL;
+    uint8_t *codes = NULL;
+    size_t point_count, code_count;
+    int i, j, pass;
+
+    for(pass=0, point_count=0, code_count=0; pass<2; pass++, point_count=0, code_count=0)
+    {
+        for(i=0; i<ctx->count; i++)
+        {
+            blob_t *b = ctx->blobs + i;
+            const int n = contours ? b->internal_count : 0;
+            for(j=-1; j<n; j++)
+            {
+                contour_t *c = (j < 0) ? &b->external : (b->internal + j);
+                /* Only the first point is stored with chain codes. */
+                const size_t count = (chain && (c->count > 1)) ? 1 : (size_t)c->count;
+                const size_t size = (chain && (c->count > 1)) ? (((3 * (size_t)(c->count - 1)) + 7) >> 3) : 0;
+                if(pass && count)
+                {
+                    memcpy(points + (point_count * 2), ctx->points + (c->offset * 2), count * (2 * sizeof(blob_coord_t)));
+                    if(size)
+                    {
+                        memcpy(codes + code_count, ctx->codes + c->code_offset, size);
+                    }
+                    c->offset = point_count;
+                    c->code_offset = code_count;
+                }
+                point_count += count;
+                code_count  += size;
+            }
+        }
+        if(0 == pass)
+        {
+            if(((2 * point_count) >= ctx->point_count) && ((2 * code_count) >= ctx->code_count))
+            {
+                return 1;
+            }
+            points = (blob_coord_t*)BLOB_MALLOC((point_count ? point_count : 1) * (2 * sizeof(blob_coord_t)));
+            codes  = (uint8_t*)BLOB_MALLOC(code_count ? code_count : 1);
+            if((NULL == points) || (NULL == codes))
+            {
+                BLOB_FREE(points);
+                BLOB_FREE(codes);
+                BLOB_ERROR("Out of memory");
+                return 0;
+            }
+            BLOB_STATS_ADD(ctx, contour_reallocs, 2);
+            BLOB_STATS_ADD(ctx, contour_bytes, (point_count * (2 * sizeof(blob_coord_t))) + code_count);
+        }
+        else
+        {
+            BLOB_FREE(ctx->points);
+            BLOB_FREE(ctx->codes);
+            ctx->points = points;
+            ctx->point_count = point_count;
+            ctx->point_capacity = point_count ? point_count : 1;
+            ctx->codes = codes;
+            ctx->code_count = code_count;
+            ctx->code_capacity = code_count ? code_count : 1;
+        }
+    }
+    return 1;
+}
+
+/* Update the results of the previous frame. */
+int find_blobs_update_ctx(blob_context_t *ctx,
+                          blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                          const uint8_t *in, blob_coord_t in_w, blob_coord_t in_h,
+                          const blob_rect_t *dirty, int dirty_count, int flags)
+{
+    blob_context_t *w;
+    blob_source_t src;
+    int *index, *owner, *parent, *boxes;
+    int i, k, r, g, max_label, kept;
+    int x, y;
+    label_t next;
+
+    /* sanity check. */
+    if((NULL == ctx) || (NULL == in) || (dirty_count < 0))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if((ctx->min_perimeter > 0) || (ctx->min_area > 0))
+    {
+        BLOB_ERROR("Blobs can not be filtered by an incremental labelling");
+        return 0;
+    }
+    if(flags & BLOB_NO_LABELS)
+    {
+        BLOB_ERROR("Incremental labelling requires the labels");
+        return 0;
+    }
+    if(flags & BLOB_TWO_PASS)
+    {
+        BLOB_ERROR("Incremental labelling requires the contour tracing");
+        return 0;
+    }
+    if(flags & BLOB_CONTOUR_TREE)
+    {
+        BLOB_ERROR("Incremental labelling does not maintain the contour tree");
+        return 0;
+    }
+    /* The bounding boxes tell which pixels may belong to a removed blob. */
+    flags |= BLOB_FEATURES;
+
+    blob_roi_clamp(&roi_x, &roi_y, &roi_w, &roi_h, in_w, in_h);
+    if(   (NULL == dirty) || (0 == roi_w) || (flags != ctx->update_flags)
+       || (roi_x != ctx->update_x) || (roi_y != ctx->update_y)
+       || (roi_w != ctx->label_w) || (roi_h != ctx->label_h) )
+    {
+        return find_blobs_update_all(ctx, roi_x, roi_y, roi_w, roi_h, in, in_w, in_h, flags);
+    }
+    /* The results can only be updated again if this call succeeds. */
+    ctx->update_flags = 0;
+    BLOB_MEMSET(&ctx->stats, 0, sizeof(blob_stats_t));
+
+    for(k=0, max_label=0; k<ctx->count; k++)
+    {
+        if(ctx->blobs[k].label > max_label)
+        {
+            max_label = ctx->blobs[k].label;
+        }
+    }
+    /* Blob (then group) of each label, group of each blob, and grown
+       rectangle and box of each group. */
+    if( !blob_scratch_reserve(ctx, ((size_t)max_label + 1 + (size_t)ctx->count + (9 * (size_t)dirty_count)) * sizeof(int)) )
+    {
+        return 0;
+    }
+    index  = (int*)ctx->scratch;
+    owner  = index + (max_label + 1);
+    parent = owner + ctx->count;
+    boxes  = parent + dirty_count;
+
+    /* 1. Group the rectangles and the blobs. */
+    for(i=0; i<=max_label; i++)
+    {
+        index[i] = -2;
+    }
+    for(k=0; k<ctx->count; k++)
+    {
+        index[ctx->blobs[k].label] = k;
+        owner[k] = -1;
+    }
+    for(r=0; r<dirty_count; r++)
+    {
+        int *box = boxes + (8 * r);
+        parent[r] = blob_rect_clamp(dirty + r, 1, roi_x, roi_y, roi_w, roi_h, box) ? r : -1;
+        for(i=0; (i<r) && (parent[r] >= 0); i++)
+        {
+            const int *other = boxes + (8 * i);
+            if(   (parent[i] >= 0)
+               && (box[0] <= other[2]) && (other[0] <= box[2])
+               && (box[1] <= other[3]) && (other[1] <= box[3]) )
+            {
+                blob_uf_union(parent, i, r);
+            }
+        }
+    }
+    for(r=0; r<dirty_count; r++)
+    {
+        const int *box = boxes + (8 * r);
+        if(parent[r] < 0)
+        {
+            continue;
+        }
+        for(y=box[1]; y<=box[3]; y++)
+        {
+            const label_t *line = ctx->label + ((ptrdiff_t)roi_w * y);
+            for(x=box[0]; x<=box[2]; x++)
+            {
+                const label_t l = line[x];
+                if((l > 0) && (l <= max_label) && (index[l] >= 0))
+                {
+                    if(owner[index[l]] < 0)
+                    {
+                        owner[index[l]] = r;
+                    }
+                    else
+                    {
+                        blob_uf_union(parent, owner[index[l]], r);
+                    }
+                }
+            }
+        }
+    }
+    /* The root of a group is its first rectangle. */
+    for(r=0; r<dirty_count; r++)
+    {
+        const int *box = boxes + (8 * r);
+        if(parent[r] < 0)
+        {
+            continue;
+        }
+        g = blob_uf_find(parent, r);
+        if(g == r)
+        {
+            memcpy(boxes + (8 * g) + 4, box, 4 * sizeof(int));
+        }
+        else
+        {
+            blob_box_add(boxes + (8 * g) + 4, box[0], box[1], box[2], box[3]);
+        }
+    }
+
+    /* 2. Remove the blobs of the groups. Their labels are not reused. */
+    for(k=0, kept=0; k<ctx->count; k++)
+    {
+        blob_t *b = ctx->blobs + k;
+        if(owner[k] >= 0)
+        {
+            g = blob_uf_find(parent, owner[k]);
+            index[b->label] = g;
+            blob_box_add(boxes + (8 * g) + 4, b->features.min_x - roi_x, b->features.min_y - roi_y,
+                                              b->features.max_x - roi_x, b->features.max_y - roi_y);
+            continue;
+        }
+        index[b->label] = -1;
+        if(k != kept)
+        {
+            /* Swap the blobs so that no contour array is lost. */
+            blob_t tmp = ctx->blobs[kept];
+            ctx->blobs[kept] = *b;
+            *b = tmp;
+        }
+        kept++;
+    }
+    ctx->count = kept;
+
+    /* 3. Label the groups again. */
+    if( !blob_workers_reserve(ctx, 1) )
+    {
+        return 0;
+    }
+    w = ctx->workers;
+    w->min_perimeter = 0;
+    w->min_area = 0;
+    next = 1;
+    for(g=0; g<dirty_count; g++)
+    {
+        const int *box = boxes + (8 * g) + 4;
+        const blob_coord_t box_w = (blob_coord_t)(box[2] + 1 - box[0]);
+        const blob_coord_t box_h = (blob_coord_t)(box[3] + 1 - box[1]);
+        const size_t count = (size_t)box_w * (size_t)box_h;
+        if(parent[g] != g)
+        {
+            continue;
+        }
+        blob_context_reset(w);
+        if( !blob_label_reserve(w, count) || !blob_bits_reserve(w, count) )
+        {
+            return 0;
+        }
+        BLOB_MEMSET(w->label, 0, count * sizeof(label_t));
+        BLOB_MEMSET(w->bits, 0, count);
+        /* Foreground pixels of the rectangles. */
+        for(r=g; r<dirty_count; r++)
+        {
+            int rect[4];
+            if((parent[r] < 0) || (blob_uf_find(parent, r) != g))
+            {
+                continue;
+            }
+            if( !blob_rect_clamp(dirty + r, 0, roi_x, roi_y, roi_w, roi_h, rect) )
+            {
+                continue;
+            }
+            for(y=rect[1]; y<=rect[3]; y++)
+            {
+                const uint8_t *line = in + roi_x + ((ptrdiff_t)in_w * (roi_y + y));
+                uint8_t *out = w->bits + ((ptrdiff_t)box_w * (y - box[1])) - box[0];
+                label_t *label = ctx->label + ((ptrdiff_t)roi_w * y);
+                for(x=rect[0]; x<=rect[2]; x++)
+                {
+                    out[x] = (0 != line[x]);
+                    label[x] = 0;
+                }
+            }
+        }
+        /* Pixels of the removed blobs outside of the rectangles. */
+        for(y=box[1]; y<=box[3]; y++)
+        {
+            uint8_t *out = w->bits + ((ptrdiff_t)box_w * (y - box[1])) - box[0];
+            label_t *label = ctx->label + ((ptrdiff_t)roi_w * y);
+            for(x=box[0]; x<=box[2]; x++)
+            {
+                if((label[x] > 0) && (label[x] <= max_label) && (index[label[x]] == g))
+                {
+                    out[x] = 1;
+                    label[x] = 0;
+                }
+            }
+        }
 
-/* Add internal contour */
-static int blob_add_internal(blob_t *b)
-{
-    contour_t *tmp = (contour_t*)BLOB_REALLOC(b->internal, (b->internal_count+1) * sizeof(contour_t));
-    if(NULL == tmp)
+        src.data   = w->bits;
+        src.stride = box_w;
+        src.x      = 0;
+        if( !find_blobs_scan_u8(w, &src, w->label, box_w, roi_x + box[0], roi_y + box[1], box_w, box_h, flags) )
+        {
+            return 0;
+        }
+        blob_stats_move(&ctx->stats, &w->stats);
+        for(k=0; k<w->count; k++)
+        {
+            while((next <= max_label) && (-2 != index[next]))
+            {
+                next++;
+            }
+            if(next == BLOB_LABEL_MAX)
+            {
+                /* The labels of the previous frame are all used. */
+                return find_blobs_update_all(ctx, roi_x, roi_y, roi_w, roi_h, in, in_w, in_h, flags);
+            }
+            if( !blob_copy(ctx, w->blobs + k, flags, next) )
+            {
+                return 0;
+            }
+            w->blobs[k].label = next++;
+        }
+        for(y=0; y<box_h; y++)
+        {
+            const label_t *in_label = w->label + ((ptrdiff_t)box_w * y);
+            label_t *label = ctx->label + ((ptrdiff_t)roi_w * (box[1] + y)) + box[0];
+            for(x=0; x<box_w; x++)
+            {
+                if(in_label[x] > 0)
+                {
+                    label[x] = w->blobs[in_label[x] - 1].label;
+                }
+                else if((in_label[x] < 0) && (0 == label[x]))
+                {
+                    label[x] = -1;
+                }
+            }
+        }
+    }
+
+    if(ctx->arena && !contour_pool_compact(ctx, flags))
     {
-        BLOB_ERROR("Out of memory");
         return 0;
     }
-    BLOB_MEMSET(&tmp[b->internal_count], 0, sizeof(contour_t));
-    b->internal = tmp;
-    b->internal_count++;
+    contour_pool_bind(ctx, flags);
+    ctx->update_flags = flags;
     return 1;
 }
 
-/* Destroy all blobs created by find_blobs. */
-void destroy_blobs(blob_t *blobs, int count)
+/* Run of the previous or current row of a stream. */
+struct blob_stream_run_t
+{
+    blob_coord_t x0, x1;
+    /* Blob slot. */
+    int blob;
+};
+
+/* Run of an open blob. */
+typedef struct
+{
+    blob_coord_t y, x0, x1;
+} blob_span_t;
+
+/* Open blob.
+   The blobs are merged with union-find. A slot is released when its blob
+   is closed or merged into another one, but it is only reused after the
+   current row, as the runs of the previous row may still reference it. */
+struct blob_stream_blob_t
+{
+    /* Union-find parent. */
+    int parent;
+    /* Next slot in the free or pending list. */
+    int next;
+    /* Bounding box. */
+    blob_coord_t min_x, min_y, max_x, max_y;
+    /* Runs. */
+    blob_span_t *spans;
+    int count, capacity;
+};
+
+/* Initialize an empty stream. */
+void blob_stream_init(blob_stream_t *stream)
+{
+    BLOB_MEMSET(stream, 0, sizeof(blob_stream_t));
+    blob_context_init(&stream->ctx);
+    stream->free_slot = stream->pending_slot = -1;
+}
+
+/* Release all the memory held by a stream. */
+void blob_stream_destroy(blob_stream_t *stream)
 {
     int i;
-    if(NULL == blobs)
+    blob_context_destroy(&stream->ctx);
+    for(i=0; i<2; i++)
     {
-        return;
+        if(NULL != stream->runs[i])
+        {
+            BLOB_FREE(stream->runs[i]);
+        }
     }
-    
-    for(i=0; i<count; i++)
+    if(NULL != stream->open)
     {
-        if(NULL != blobs[i].external.points)
+        for(i=0; i<stream->open_capacity; i++)
         {
-            BLOB_FREE(blobs[i].external.points);
+            if(NULL != stream->open[i].spans)
+            {
+                BLOB_FREE(stream->open[i].spans);
+            }
         }
+        BLOB_FREE(stream->open);
+    }
+    blob_stream_init(stream);
+}
 
-        if(NULL != blobs[i].internal)
+/* Start labelling a new image. */
+int blob_stream_begin(blob_stream_t *stream, blob_coord_t width, int flags, blob_stream_callback_t callback, void *user)
+{
+    int i;
+    /* sanity check. */
+    if((NULL == stream) || (NULL == callback) || (width <= 0))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    if(flags & BLOB_CONTOUR_TREE)
+    {
+        BLOB_ERROR("Streams do not build the contour tree");
+        return 0;
+    }
+    /* A row has at most (width+1)/2 runs. */
+    if(stream->run_capacity < ((width + 1) / 2))
+    {
+        for(i=0; i<2; i++)
         {
-            int j;
-            for(j=0; j<blobs[i].internal_count; j++)
+            struct blob_stream_run_t *tmp = (struct blob_stream_run_t*)BLOB_REALLOC(stream->runs[i], ((width + 1) / 2) * sizeof(struct blob_stream_run_t));
+            if(NULL == tmp)
             {
-                if(NULL != blobs[i].internal[j].points)
-                {
-                    BLOB_FREE(blobs[i].internal[j].points);
-                }
+                BLOB_ERROR("Out of memory");
+                return 0;
             }
-            BLOB_FREE(blobs[i].internal);
+            stream->runs[i] = tmp;
         }
+        stream->run_capacity = (width + 1) / 2;
     }
-    BLOB_FREE(blobs);
+    stream->width = width;
+    stream->y = 0;
+    stream->flags = flags & ~BLOB_NO_LABELS;
+    stream->callback = callback;
+    stream->user = user;
+    stream->label = 0;
+    stream->run_count[0] = stream->run_count[1] = 0;
+    stream->open_count = 0;
+    stream->free_slot = stream->pending_slot = -1;
+    BLOB_MEMSET(&stream->ctx.stats, 0, sizeof(blob_stats_t));
+    return 1;
 }
 
-/* Extract blob contour (external or internal). */
-static int contour_trace(uint8_t external, label_t current, int16_t x, int16_t y,
-                         int16_t roi_x, int16_t roi_y, int16_t roi_w, int16_t roi_h,
-                         uint8_t *in, int16_t line_stride, label_t *label, contour_t *contour)
+/* Get a blob slot. */
+static int blob_stream_alloc(blob_stream_t *stream)
 {
-    static const int16_t dx[8] = { 1, 1, 0,-1,-1,-1, 0, 1 };
-    static const int16_t dy[8] = { 0, 1, 1, 1, 0,-1,-1,-1 };
+    int i = stream->free_slot;
+    if(i >= 0)
+    {
+        stream->free_slot = stream->open[i].next;
+    }
+    else
+    {
+        if(stream->open_count == stream->open_capacity)
+        {
+            const int capacity = stream->open_capacity ? (stream->open_capacity * 2) : 64;
+            struct blob_stream_blob_t *tmp = (struct blob_stream_blob_t*)BLOB_REALLOC(stream->open, capacity * sizeof(struct blob_stream_blob_t));
+            if(NULL == tmp)
+            {
+                BLOB_ERROR("Out of memory");
+                return -1;
+            }
+            BLOB_MEMSET(tmp + stream->open_capacity, 0, (capacity - stream->open_capacity) * sizeof(struct blob_stream_blob_t));
+            stream->open = tmp;
+            stream->open_capacity = capacity;
+        }
+        i = stream->open_count++;
+    }
+    stream->open[i].parent = i;
+    stream->open[i].count = 0;
+    return i;
+}
 
-    int i = external ? 7 : 3;
-    int j;
+/* Release a blob slot once the current row is done. */
+static void blob_stream_release(blob_stream_t *stream, int i)
+{
+    stream->open[i].next = stream->pending_slot;
+    stream->pending_slot = i;
+}
 
-    int16_t x0 = x;
-    int16_t y0 = y;
+static int blob_stream_find(blob_stream_t *stream, int i)
+{
+    while(stream->open[i].parent != i)
+    {
+        stream->open[i].parent = stream->open[stream->open[i].parent].parent;
+        i = stream->open[i].parent;
+    }
+    return i;
+}
 
-    int16_t xx = -1;
-    int16_t yy = -1;
+/* Add a run to an open blob. */
+static int blob_stream_add_span(struct blob_stream_blob_t *b, blob_coord_t y, blob_coord_t x0, blob_coord_t x1)
+{
+    if(b->count == b->capacity)
+    {
+        const int capacity = b->capacity ? (b->capacity * 2) : 16;
+        blob_span_t *tmp = (blob_span_t*)BLOB_REALLOC(b->spans, capacity * sizeof(blob_span_t));
+        if(NULL == tmp)
+        {
+            BLOB_ERROR("Out of memory");
+            return 0;
+        }
+        b->spans = tmp;
+        b->capacity = capacity;
+    }
+    if(0 == b->count)
+    {
+        b->min_x = x0;
+        b->max_x = x1;
+        b->min_y = y;
+    }
+    else
+    {
+        if(x0 < b->min_x) { b->min_x = x0; }
+        if(x1 > b->max_x) { b->max_x = x1; }
+    }
+    b->max_y = y;
+    b->spans[b->count].y  = y;
+    b->spans[b->count].x0 = x0;
+    b->spans[b->count].x1 = x1;
+    b->count++;
+    return 1;
+}
 
-    label[x0 + (roi_w * y0)] = current;
+/* Merge 2 open blobs and return the root of the merged blob. The runs of
+   the smallest one are moved to the largest one. */
+static int blob_stream_union(blob_stream_t *stream, int a, int b)
+{
+    struct blob_stream_blob_t *dst, *src;
+    blob_coord_t min_x, min_y, max_x, max_y;
+    int i;
+    a = blob_stream_find(stream, a);
+    b = blob_stream_find(stream, b);
+    if(a == b)
+    {
+        return a;
+    }
+    if(stream->open[a].count < stream->open[b].count)
+    {
+        const int tmp = a; a = b; b = tmp;
+    }
+    dst = stream->open + a;
+    src = stream->open + b;
+    min_x = (src->min_x < dst->min_x) ? src->min_x : dst->min_x;
+    min_y = (src->min_y < dst->min_y) ? src->min_y : dst->min_y;
+    max_x = (src->max_x > dst->max_x) ? src->max_x : dst->max_x;
+    max_y = (src->max_y > dst->max_y) ? src->max_y : dst->max_y;
+    for(i=0; i<src->count; i++)
+    {
+        if( !blob_stream_add_span(dst, src->spans[i].y, src->spans[i].x0, src->spans[i].x1) )
+        {
+            return -1;
+        }
+    }
+    dst->min_x = min_x;
+    dst->min_y = min_y;
+    dst->max_x = max_x;
+    dst->max_y = max_y;
+    src->count = 0;
+    src->parent = a;
+    blob_stream_release(stream, b);
+    return a;
+}
 
-    for(int done = 0; !done; )
+/* Trace a closed blob on a bitmap covering its bounding box and report it. */
+static int blob_stream_emit(blob_stream_t *stream, int i)
+{
+    struct blob_stream_blob_t *b = stream->open + i;
+    blob_context_t *ctx = &stream->ctx;
+    const blob_coord_t w = b->max_x + 1 - b->min_x;
+    const blob_coord_t h = b->max_y + 1 - b->min_y;
+    const size_t size = (size_t)w * (size_t)h;
+    blob_source_t src;
+    int k;
+
+    if(ctx->min_area > 0)
     {
-        if(NULL != contour)
+        /* Small blobs are not even traced. */
+        int64_t area = 0;
+        for(k=0; k<b->count; k++)
+        {
+            area += b->spans[k].x1 + 1 - b->spans[k].x0;
+        }
+        if(area < ctx->min_area)
+        {
+            b->count = 0;
+            blob_stream_release(stream, i);
+            return 1;
+        }
+    }
+    if(stream->label == (BLOB_LABEL_MAX - 1))
+    {
+        BLOB_ERROR("Too many blobs for label_t");
+        return 0;
+    }
+    blob_context_reset(ctx);
+    if( !blob_label_reserve(ctx, size) || !blob_bits_reserve(ctx, size) )
+    {
+        return 0;
+    }
+    BLOB_MEMSET(ctx->label, 0, size * sizeof(label_t));
+    BLOB_MEMSET(ctx->bits, 0, size);
+    for(k=0; k<b->count; k++)
+    {
+        const blob_span_t *span = b->spans + k;
+        BLOB_MEMSET(ctx->bits + ((ptrdiff_t)w * (span->y - b->min_y)) + (span->x0 - b->min_x), 1, span->x1 + 1 - span->x0);
+    }
+    src.data   = ctx->bits;
+    src.stride = w;
+    src.x      = 0;
+    if( !find_blobs_scan_u8(ctx, &src, ctx->label, w, b->min_x, b->min_y, w, h, stream->flags) )
+    {
+        return 0;
+    }
+    /* The runs are 8-connected, so there is only one blob, unless it
+       was discarded. */
+    if(ctx->count > 0)
+    {
+        ctx->blobs[0].label = ++stream->label;
+        stream->callback(ctx->blobs, stream->user);
+    }
+    b->count = 0;
+    blob_stream_release(stream, i);
+    return 1;
+}
+
+/* Report the blobs of the previous row which are not continued by the current row. */
+static int blob_stream_close(blob_stream_t *stream, const struct blob_stream_run_t *runs, int count)
+{
+    int k;
+    for(k=0; k<count; k++)
+    {
+        const int i = blob_stream_find(stream, runs[k].blob);
+        /* A blob is reported once, its slot is emptied. */
+        if(stream->open[i].count && (stream->open[i].max_y < stream->y))
         {
-            if(0 == contour_add_point(contour, roi_x+x0, roi_y+y0))
+            if( !blob_stream_emit(stream, i) )
             {
                 return 0;
             }
         }
+    }
+    /* The released slots are not referenced anymore. */
+    while(stream->pending_slot >= 0)
+    {
+        const int i = stream->pending_slot;
+        stream->pending_slot = stream->open[i].next;
+        stream->open[i].next = stream->free_slot;
+        stream->free_slot = i;
+    }
+    return 1;
+}
 
-        /* Scan around current pixel in clockwise order. */
-        for(j=0; j<8; j++, i=(i+1)&7)
+/* Label the next rows of the image. */
+int blob_stream_push_rows(blob_stream_t *stream, const uint8_t *rows, int count, ptrdiff_t stride)
+{
+    int j;
+    /* sanity check. */
+    if((NULL == stream) || (NULL == rows) || (NULL == stream->callback))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    /* blob_stream_finish adds an empty row. */
+    if(count > ((int64_t)BLOB_COORD_MAX - 1 - stream->y))
+    {
+        BLOB_ERROR("Too many rows for blob_coord_t");
+        return 0;
+    }
+    for(j=0; j<count; j++, rows+=stride)
+    {
+        struct blob_stream_run_t *previous = stream->runs[stream->y & 1];
+        struct blob_stream_run_t *current  = stream->runs[(stream->y + 1) & 1];
+        const int previous_count = stream->run_count[stream->y & 1];
+        int current_count = 0;
+        int k, p;
+        blob_coord_t x;
+
+        /* Extract the runs of the row. */
+        for(x=source_skip_u8(rows, 0, stream->width); x<stream->width; x=source_skip_u8(rows, x, stream->width))
         {
-            const int16_t x1 = x0 + dx[i];
-            const int16_t y1 = y0 + dy[i];
-            const long int offset = x1 + (roi_w * y1);
-            if((x1 < 0) || (x1 >= roi_w)) { continue; }
-            if((y1 < 0) || (y1 >= roi_h)) { continue; }
+            current[current_count].x0 = x;
+            for(; (x < stream->width) && rows[x]; x++)
+            {}
+            current[current_count].x1 = x - 1;
+            current[current_count].blob = -1;
+            current_count++;
+        }
 
-            if(in[x1 + (line_stride * y1)])
+        /* Connect them to the 8-connected runs of the previous row. */
+        for(k=0, p=0; k<current_count; k++)
+        {
+            struct blob_stream_run_t *run = current + k;
+            int q;
+            for(; (p < previous_count) && (previous[p].x1 < (run->x0 - 1)); p++)
+            {}
+            for(q=p; (q < previous_count) && (previous[q].x0 <= (run->x1 + 1)); q++)
             {
-                label[offset] = current;
-
-                if((xx < 0) && (yy < 0))
+                run->blob = (run->blob < 0) ? blob_stream_find(stream, previous[q].blob) : blob_stream_union(stream, run->blob, previous[q].blob);
+                if(run->blob < 0)
                 {
-                    xx = x1;
-                    yy = y1;
+                    return 0;
                 }
-                else
+            }
+            if(run->blob < 0)
+            {
+                run->blob = blob_stream_alloc(stream);
+                if(run->blob < 0)
                 {
-                    /* We are done if we crossed the first 2 contour points again. */
-                    done =    ((x == x0) && (xx == x1)) 
-                           && ((y == y0) && (yy == y1));
-                }           
-                x0 = x1;
-                y0 = y1;
-                break;
+                    return 0;
+                }
             }
-            else
+            if( !blob_stream_add_span(stream->open + run->blob, stream->y, run->x0, run->x1) )
             {
-                label[offset] = -1;
+                return 0;
             }
         }
-        /* Isolated point. */
-        if(8 == j)
+        for(k=0; k<current_count; k++)
         {
-            done = 1;
+            current[k].blob = blob_stream_find(stream, current[k].blob);
         }
-        /* Compute next start position. */
-        /* 1. Compute the neighbour index of the previous point. */
-        int previous = (i+4) & 7;
-        /* 2. Next search index is previous + 2 (mod 8). */
-        i = (previous + 2) & 7;
+        stream->run_count[(stream->y + 1) & 1] = current_count;
+
+        if( !blob_stream_close(stream, previous, previous_count) )
+        {
+            return 0;
+        }
+        stream->y++;
     }
-    
     return 1;
 }
 
+/* Report the blobs still open at the end of the image. */
+int blob_stream_finish(blob_stream_t *stream)
+{
+    int ret, last;
+    if((NULL == stream) || (NULL == stream->callback))
+    {
+        BLOB_ERROR("One or more invalid arguments");
+        return 0;
+    }
+    /* Close the blobs of the last row as if an empty row was pushed. */
+    last = stream->y & 1;
+    stream->y++;
+    ret = blob_stream_close(stream, stream->runs[last], stream->run_count[last]);
+    stream->callback = NULL;
+    return ret;
+}
+
 /* Compute connected components labels and contours. */
-int find_blobs(int16_t roi_x, int16_t roi_y, int16_t roi_w, int16_t roi_h,
-               uint8_t    *in,  int16_t     in_w, int16_t     in_h, 
-               label_t **label, int16_t *label_w, int16_t *label_h, 
+int find_blobs(blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+               uint8_t    *in,  blob_coord_t     in_w, blob_coord_t     in_h, 
+               label_t **label, blob_coord_t *label_w, blob_coord_t *label_h, 
                blob_t** blobs, int *count, int extract_internal)
 {
-    uint8_t *ptr_in, *line_in, *roi_in;
-    label_t *ptr_label;
-
-    int16_t i, j;
-    label_t current;
+    blob_context_t ctx;
+    int ret;
 
     /* sanity check. */
     if(   (NULL == label) || (NULL == label_w) || (NULL == label_h)
@@ -375,97 +5525,30 @@ int find_blobs(int16_t roi_x, int16_t roi_y, int16_t roi_w, int16_t roi_h,
         return 0;
     }
 
+    *label = NULL;
     *blobs = NULL;
     *count = 0;
 
-    /* adjust ROI */
-    if((roi_x >= in_w) || (roi_y >= in_h))
-    {
-        /* nothing to do */
-        return 1;
-    }
-    if(roi_x < 0) { roi_x = 0; }
-    if(roi_y < 0) { roi_y = 0; }
-    if((roi_x + roi_w) > in_w) { roi_w = in_w - roi_x; }
-    if((roi_y + roi_h) > in_h) { roi_h = in_h - roi_h; }
-    if((roi_w <= 0) || (roi_h <= 0))
-    {
-        /* nothing to do */
-        return 1;
-    }
-
-    /* create label buffer */
-    *label = (label_t*)BLOB_MALLOC(roi_w * roi_h * sizeof(label_t));
-    if(NULL == label)
+    blob_context_init(&ctx);
+    /* Each contour gets its own array so that destroy_blobs can release it. */
+    ctx.arena = 0;
+    ret = find_blobs_ctx(&ctx, roi_x, roi_y, roi_w, roi_h, in, in_w, in_h, extract_internal ? BLOB_EXTRACT_INTERNAL : 0);
+#if defined(BLOB_STATS)
+    blob_find_blobs_stats = ctx.stats;
+#endif
+    if(!ret)
     {
-        BLOB_ERROR("Out of memory");
+        blob_context_destroy(&ctx);
         return 0;
     }
-    *label_w = roi_w;
-    *label_h = roi_h;
-    
-    BLOB_MEMSET(*label, 0, roi_w * roi_h * sizeof(label_t));
-    
-    current = 1;
-
-    roi_in = in + roi_x + (in_w * roi_y);
-    line_in = roi_in;
-    ptr_label = *label;
-    
-    for(j=0; j<roi_h; j++, line_in+=in_w)
-    {
-        for(i=0, ptr_in=line_in; i<roi_w; i++, ptr_in++, ptr_label++)
-        {
-            if(0 == *ptr_in) { continue; }
-            
-            const uint8_t above_in    = (j > 0) ? *(ptr_in - in_w) : 0;
-            const uint8_t below_in    = (j < (roi_h-1)) ? *(ptr_in + in_w) : 0; 
-            const label_t below_label = (j < (roi_h-1)) ? *(ptr_label + roi_w) : -1;
-            /* 1. new external countour */
-            if((0 == *ptr_label) && (0 == above_in))
-            {
-                /* add new blob */
-                if( !blob_add(blobs, count) )
-                {
-                    return 0;
-                }
-                (*blobs+(*count-1))->label = current;
-                /* trace external contour */
-                contour_trace(1, current, i, j, roi_x, roi_y, roi_w, roi_h, roi_in, in_w, *label, &(*blobs+(*count-1))->external);
-                ++current;
-            }
-            /* 2. new internal countour */
-            else if((0 == below_in) && (0 == below_label))
-            {
-                label_t current_label = *ptr_label ? *ptr_label : *(ptr_label-1); // [todo] deserve a bit of explanation
-                
-                /* add a new internal contour to the corresponding blob. */
-                blob_t *current_blob = *blobs + (current_label-1);
-                contour_t *internal = NULL;
-                if(extract_internal)
-                {
-                    if( !blob_add_internal(current_blob) )
-                    {
-                        return 0;
-                    }
-                    internal = current_blob->internal + current_blob->internal_count - 1;
-                }
-                else
-                {
-                    /* even if we don't want to store the internal contours,
-                       we may want to know the number of holes. */
-                    current_blob->internal_count++;
-                }
 
-                contour_trace(0, current_label, i, j, roi_x, roi_y, roi_w, roi_h, roi_in, in_w, *label, internal);
-            }
-            /* 3. internal element */
-            else if(0 == *ptr_label)
-            {
-                *ptr_label = (i > 0) ? *(ptr_label - 1) : 0;
-            }
-        }
-    }
+    /* The caller takes ownership of the context buffers. The context was
+       fresh so the unused blob slots do not hold any memory. */
+    *label   = ctx.label;
+    *label_w = ctx.label_w;
+    *label_h = ctx.label_h;
+    *blobs   = ctx.blobs;
+    *count   = ctx.count;
     return 1;
 }
 #endif /* BLOB_IMPLEMENTATION */
@@ -0,0 +1,372 @@
+/**
+ * blob.hpp - C++ interface of blob
+ * ================================
+ * Licensed under the MIT License
+ * (c) 2016-2024 Vincent Cruz
+ *
+ * Header only C++20 wrapper around `blob.h`. The implementation is still
+ * included in a single translation unit with `BLOB_IMPLEMENTATION` (or the
+ * `blob` library is linked).
+ *
+ *  - `blob::result` owns the label buffer and the blobs allocated by
+ *    `find_blobs`, and releases them when it is destroyed.
+ *  - `blob::workspace` owns a `blob_context_t`. It can be moved but not
+ *    copied. Its blobs and labels are valid until its next call.
+ *  - `blob::points` and `blob::holes` return `std::span` views over the
+ *    contour points and the holes of a blob, without any copy.
+ *  - `blob::workspace::find_if` labels an image of any arithmetic pixel
+ *    type (`uint8_t`, `uint16_t`, `float`...) whose foreground is given by
+ *    a predicate type, such as `blob::nonzero`, `blob::above<T>` or
+ *    `blob::in_range<Lo, Hi>`.
+ *
+ * Usage:
+ * ------
+ ```
+ * blob::workspace ws;
+ * while(...)
+ * {
+ *     // depth is a float image, the foreground being the pixels closer than 1.5 m.
+ *     if(ws.find_if<blob::in_range<0.1f, 1.5f>>(0, 0, w, h, depth, w, h, 0, BLOB_EXTRACT_INTERNAL))
+ *     {
+ *         for(const blob_t &b : ws.blobs())
+ *         {
+ *             for(blob::point p : blob::points(b.external)) { ... }
+ *         }
+ *     }
+ * }
+ ```
+ * The scan and the contour tracer are compiled once with the C
+ * implementation, so they only read 1 byte per pixel images. `find_if`
+ * evaluates the predicate once per pixel of the ROI in a single loop that
+ * the compiler can inline and vectorize, and stores the result in a mask
+ * kept in the workspace. No mask is built for 1 byte per pixel images with
+ * `blob::nonzero` or `blob::in_range`, which are handled by
+ * `find_blobs_stride_ctx` and `find_blobs_range_ctx`.
+ */
+#ifndef BLOB_INCLUDE_HPP
+#define BLOB_INCLUDE_HPP
+
+#include <cassert>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include "blob.h"
+
+namespace blob {
+
+/**
+ * Contour point, laid out like the coordinates stored in `contour_t::points`.
+ */
+struct point
+{
+    blob_coord_t x, y;
+};
+
+static_assert(sizeof(point) == (2 * sizeof(blob_coord_t)), "point must match the layout of contour_t::points");
+
+/**
+ * Get the points of a contour.
+ * The contour must not be stored as chain codes (see `contour_decode`).
+ * @param [in] contour Contour.
+ * @return View over the points of the contour.
+ */
+inline std::span<const point> points(const contour_t &contour) noexcept
+{
+    assert(nullptr == contour.codes);
+    if((nullptr == contour.points) || (contour.count <= 0))
+    {
+        return {};
+    }
+    return { reinterpret_cast<const point*>(contour.points), static_cast<size_t>(contour.count) };
+}
+
+/**
+ * Get the internal contours of a blob.
+ * @param [in] b Blob.
+ * @return View over the internal contours, empty if they were not extracted.
+ */
+inline std::span<const contour_t> holes(const blob_t &b) noexcept
+{
+    if((nullptr == b.internal) || (b.internal_count <= 0))
+    {
+        return {};
+    }
+    return { b.internal, static_cast<size_t>(b.internal_count) };
+}
+
+/**
+ * Foreground predicate: non-zero pixels.
+ */
+struct nonzero
+{
+    template <typename T>
+    constexpr bool operator()(T v) const noexcept { return v != T(0); }
+};
+
+/**
+ * Foreground predicate: pixels strictly greater than `Threshold`.
+ */
+template <auto Threshold>
+struct above
+{
+    template <typename T>
+    constexpr bool operator()(T v) const noexcept { return v > Threshold; }
+};
+
+/**
+ * Foreground predicate: pixels in [`Lo`, `Hi`].
+ */
+template <auto Lo, auto Hi>
+struct in_range
+{
+    template <typename T>
+    constexpr bool operator()(T v) const noexcept { return (v >= Lo) && (v <= Hi); }
+};
+
+namespace detail {
+
+template <typename Predicate>
+struct range_bounds : std::false_type {};
+
+template <auto Lo, auto Hi>
+struct range_bounds<in_range<Lo, Hi>> : std::true_type
+{
+    static constexpr auto lo = Lo;
+    static constexpr auto hi = Hi;
+};
+
+} // namespace detail
+
+/**
+ * Results of `find_blobs`.
+ * The label buffer and the blobs are released when the result is destroyed
+ * or when it is used for another call.
+ */
+class result
+{
+public:
+    result() noexcept = default;
+    result(const result&) = delete;
+    result& operator=(const result&) = delete;
+    result(result &&other) noexcept { swap(other); }
+    result& operator=(result &&other) noexcept
+    {
+        if(this != &other)
+        {
+            release();
+            swap(other);
+        }
+        return *this;
+    }
+    ~result() { release(); }
+
+    /**
+     * Compute connected components labels and contours (see `find_blobs`).
+     * @return true upon success or false if an error occured.
+     */
+    bool find(blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+              uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, bool extract_internal)
+    {
+        release();
+        return 0 != find_blobs(roi_x, roi_y, roi_w, roi_h, in, in_w, in_h,
+                               &label_, &label_w_, &label_h_, &blobs_, &count_, extract_internal ? 1 : 0);
+    }
+
+    /** Blobs. **/
+    std::span<const blob_t> blobs() const noexcept
+    {
+        return blobs_ ? std::span<const blob_t>(blobs_, static_cast<size_t>(count_)) : std::span<const blob_t>();
+    }
+    /** Label buffer (`width()` labels per row). **/
+    std::span<const label_t> labels() const noexcept
+    {
+        return label_ ? std::span<const label_t>(label_, static_cast<size_t>(label_w_) * static_cast<size_t>(label_h_)) : std::span<const label_t>();
+    }
+    /** Width of the label buffer. **/
+    blob_coord_t width() const noexcept { return label_w_; }
+    /** Height of the label buffer. **/
+    blob_coord_t height() const noexcept { return label_h_; }
+
+private:
+    void release() noexcept
+    {
+        destroy_blobs(blobs_, count_);
+        std::free(label_);
+        label_ = nullptr;
+        blobs_ = nullptr;
+        label_w_ = label_h_ = 0;
+        count_ = 0;
+    }
+    void swap(result &other) noexcept
+    {
+        std::swap(label_, other.label_);
+        std::swap(label_w_, other.label_w_);
+        std::swap(label_h_, other.label_h_);
+        std::swap(blobs_, other.blobs_);
+        std::swap(count_, other.count_);
+    }
+
+    label_t *label_ = nullptr;
+    blob_coord_t label_w_ = 0, label_h_ = 0;
+    blob_t *blobs_ = nullptr;
+    int count_ = 0;
+};
+
+/**
+ * Reusable labelling workspace.
+ * Owns a `blob_context_t` and the mask used by `find_if`. The results of a
+ * call are valid until the next one.
+ */
+class workspace
+{
+public:
+    workspace() noexcept { blob_context_init(&ctx_); }
+    workspace(const workspace&) = delete;
+    workspace& operator=(const workspace&) = delete;
+    workspace(workspace &&other) noexcept
+        : ctx_(other.ctx_)
+        , mask_(std::move(other.mask_))
+        , mask_capacity_(other.mask_capacity_)
+    {
+        blob_context_init(&other.ctx_);
+        other.mask_capacity_ = 0;
+    }
+    workspace& operator=(workspace &&other) noexcept
+    {
+        if(this != &other)
+        {
+            blob_context_destroy(&ctx_);
+            ctx_ = other.ctx_;
+            mask_ = std::move(other.mask_);
+            mask_capacity_ = other.mask_capacity_;
+            blob_context_init(&other.ctx_);
+            other.mask_capacity_ = 0;
+        }
+        return *this;
+    }
+    ~workspace() { blob_context_destroy(&ctx_); }
+
+    /** Underlying context, to set the filters or call the other entry points. **/
+    blob_context_t* context() noexcept { return &ctx_; }
+    const blob_context_t* context() const noexcept { return &ctx_; }
+
+    /**
+     * Compute connected components labels and contours of a 1 byte per
+     * pixel image (see `find_blobs_ctx`).
+     * @return true upon success or false if an error occured.
+     */
+    bool find(blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+              uint8_t *in, blob_coord_t in_w, blob_coord_t in_h, int flags)
+    {
+        return 0 != find_blobs_ctx(&ctx_, roi_x, roi_y, roi_w, roi_h, in, in_w, in_h, flags);
+    }
+
+    /**
+     * Compute connected components labels and contours of the pixels
+     * satisfying a predicate.
+     * @param [in] roi_x     X coordinate of the upper left corner of the ROI.
+     * @param [in] roi_y     Y coordinate of the upper left corner of the ROI
+     * @param [in] roi_w     Width of the ROI.
+     * @param [in] roi_h     Height of the ROI.
+     * @param [in] in        Pointer to the input image buffer.
+     * @param [in] in_w      Width of the input image.
+     * @param [in] in_h      Height of the input image.
+     * @param [in] in_stride Number of bytes between 2 rows, or 0 if rows are
+     *                       not padded.
+     * @param [in] flags     Same flags as `find_blobs_ctx`.
+     * @param [in] pred      Foreground predicate, called with a pixel value.
+     * @return true upon success or false if an error occured.
+     */
+    template <typename Predicate = nonzero, typename Pixel>
+    bool find_if(blob_coord_t roi_x, blob_coord_t roi_y, blob_coord_t roi_w, blob_coord_t roi_h,
+                 const Pixel *in, blob_coord_t in_w, blob_coord_t in_h, int in_stride, int flags,
+                 Predicate pred = Predicate())
+    {
+        static_assert(std::is_arithmetic_v<Pixel>, "pixels must be of an arithmetic type");
+        if constexpr(std::is_same_v<Pixel, uint8_t> && std::is_same_v<Predicate, nonzero>)
+        {
+            return 0 != find_blobs_stride_ctx(&ctx_, roi_x, roi_y, roi_w, roi_h, in, in_w, in_h, in_stride, nullptr, 0, flags);
+        }
+        else if constexpr(std::is_same_v<Pixel, uint8_t> && detail::range_bounds<Predicate>::value)
+        {
+            constexpr auto lo = detail::range_bounds<Predicate>::lo;
+            constexpr auto hi = detail::range_bounds<Predicate>::hi;
+            static_assert((lo >= 0) && (hi <= 255) && (lo <= hi), "invalid range for 8 bits pixels");
+            return 0 != find_blobs_range_ctx(&ctx_, roi_x, roi_y, roi_w, roi_h, in, in_w, in_h, in_stride,
+                                             static_cast<uint8_t>(lo), static_cast<uint8_t>(hi), flags);
+        }
+        else
+        {
+            if(nullptr == in)
+            {
+                return 0 != find_blobs_ctx(&ctx_, roi_x, roi_y, roi_w, roi_h, nullptr, in_w, in_h, flags);
+            }
+            /* Same clamping as the C implementation. */
+            blob_coord_t x0 = roi_x, y0 = roi_y, w = roi_w, h = roi_h;
+            if((x0 >= in_w) || (y0 >= in_h)) { w = h = 0; }
+            if(x0 < 0) { x0 = 0; }
+            if(y0 < 0) { y0 = 0; }
+            if((x0 + w) > in_w) { w = in_w - x0; }
+            if((y0 + h) > in_h) { h = in_h - y0; }
+            if((w <= 0) || (h <= 0))
+            {
+                /* Nothing to read, but the previous results are discarded. */
+                uint8_t empty = 0;
+                return 0 != find_blobs_ctx(&ctx_, roi_x, roi_y, roi_w, roi_h, &empty, in_w, in_h, flags);
+            }
+            /* The mask has the geometry of the image, so that the contours
+               are expressed in image coordinates, but only the ROI is
+               written. */
+            const size_t size = static_cast<size_t>(in_w) * static_cast<size_t>(in_h);
+            if(size > mask_capacity_)
+            {
+                mask_.reset(new (std::nothrow) uint8_t[size]);
+                mask_capacity_ = mask_ ? size : 0;
+                if(!mask_)
+                {
+                    return false;
+                }
+            }
+            const size_t stride = in_stride ? static_cast<size_t>(in_stride) : (static_cast<size_t>(in_w) * sizeof(Pixel));
+            const unsigned char *row = reinterpret_cast<const unsigned char*>(in) + (stride * static_cast<size_t>(y0));
+            uint8_t *out = mask_.get() + (static_cast<size_t>(in_w) * static_cast<size_t>(y0));
+            for(blob_coord_t j=0; j<h; j++, row+=stride, out+=in_w)
+            {
+                const Pixel *src = reinterpret_cast<const Pixel*>(row);
+                for(blob_coord_t i=x0; i<(x0+w); i++)
+                {
+                    out[i] = pred(src[i]) ? 1 : 0;
+                }
+            }
+            return 0 != find_blobs_ctx(&ctx_, roi_x, roi_y, roi_w, roi_h, mask_.get(), in_w, in_h, flags);
+        }
+    }
+
+    /** Blobs of the last call. **/
+    std::span<const blob_t> blobs() const noexcept
+    {
+        return ctx_.blobs ? std::span<const blob_t>(ctx_.blobs, static_cast<size_t>(ctx_.count)) : std::span<const blob_t>();
+    }
+    /** Label buffer of the last call (`width()` labels per row). **/
+    std::span<const label_t> labels() const noexcept
+    {
+        return ctx_.label ? std::span<const label_t>(ctx_.label, static_cast<size_t>(ctx_.label_w) * static_cast<size_t>(ctx_.label_h)) : std::span<const label_t>();
+    }
+    /** Width of the label buffer. **/
+    blob_coord_t width() const noexcept { return ctx_.label_w; }
+    /** Height of the label buffer. **/
+    blob_coord_t height() const noexcept { return ctx_.label_h; }
+
+private:
+    blob_context_t ctx_;
+    std::unique_ptr<uint8_t[]> mask_;
+    size_t mask_capacity_ = 0;
+};
+
+} // namespace blob
+
+#endif /* BLOB_INCLUDE_HPP */
@@ -0,0 +1,433 @@
+/* Times the labelling of synthetic images and of the images of a directory
+ * (test/data by default). For each workload, find_blobs and find_blobs_ctx
+ * (with a context reused across calls) are called repeatedly and the
+ * throughput, the number of allocations per call and the median and 99th
+ * percentile latencies are reported.
+ *
+ * Licensed under the MIT License
+ * (c) 2016-2023 Vincent Cruz
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <getopt.h>
+
+#include "stb_image.h"
+
+/* Count the allocations made by the library. */
+static size_t g_alloc_count = 0;
+
+static void* bench_malloc(size_t size)
+{
+    g_alloc_count++;
+    return malloc(size);
+}
+
+static void* bench_realloc(void *ptr, size_t size)
+{
+    g_alloc_count++;
+    return realloc(ptr, size);
+}
+
+#define BLOB_MALLOC(sz)         bench_malloc(sz)
+#define BLOB_REALLOC(p, new_sz) bench_realloc(p, new_sz)
+#define BLOB_FREE(p)            free(p)
+
+#define BLOB_IMPLEMENTATION
+#include <blob.h>
+
+#ifndef BLOB_BENCH_DATA
+#define BLOB_BENCH_DATA "data"
+#endif
+
+/* Benchmark workload. */
+typedef struct
+{
+    char name[64];
+    uint8_t *image;
+    int width;
+    int height;
+} workload_t;
+
+/* Return the monotonic time in nanoseconds. */
+static int64_t bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/* Simple deterministic random number generator (xorshift32). */
+static uint32_t bench_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Random noise with the given percentage of foreground pixels. */
+static void generate_noise(uint8_t *image, int width, int height, int density)
+{
+    uint32_t state = 0x2545f491;
+    int i;
+    for(i=0; i<(width*height); i++)
+    {
+        image[i] = ((int)(bench_rand(&state) % 100) < density) ? 1 : 0;
+    }
+}
+
+/* Checkerboard made of size x size cells. */
+static void generate_checker(uint8_t *image, int width, int height, int size)
+{
+    int i, j;
+    for(j=0; j<height; j++)
+    {
+        for(i=0; i<width; i++)
+        {
+            image[i + (j*width)] = ((i/size) + (j/size)) & 1;
+        }
+    }
+}
+
+/* Perfect maze with 1 pixel wide walls and corridors. The walls form a
+   single blob with a lot of long contours. */
+static int generate_labyrinth(uint8_t *image, int width, int height)
+{
+    static const int dx[4] = { 2, 0, -2, 0 };
+    static const int dy[4] = { 0, 2, 0, -2 };
+    uint32_t state = 0x9e3779b9;
+    int *stack;
+    int top;
+    int cw = (width - 1) / 2;
+    int ch = (height - 1) / 2;
+
+    memset(image, 1, width * height);
+    if((cw <= 0) || (ch <= 0))
+    {
+        return 1;
+    }
+    stack = (int*)malloc(cw * ch * sizeof(int));
+    if(NULL == stack)
+    {
+        return 0;
+    }
+    /* Carve the corridors with a depth first search. */
+    top = 0;
+    stack[top++] = 1 + width;
+    image[1 + width] = 0;
+    while(top > 0)
+    {
+        int current = stack[top-1];
+        int x = current % width;
+        int y = current / width;
+        int k, n;
+        int next[4];
+        for(k=0, n=0; k<4; k++)
+        {
+            int x1 = x + dx[k];
+            int y1 = y + dy[k];
+            if((x1 > 0) && (x1 < (2*cw)) && (y1 > 0) && (y1 < (2*ch)) && image[x1 + (y1*width)])
+            {
+                next[n++] = k;
+            }
+        }
+        if(0 == n)
+        {
+            top--;
+            continue;
+        }
+        k = next[bench_rand(&state) % n];
+        image[x + (dx[k]/2) + ((y + (dy[k]/2)) * width)] = 0;
+        image[x + dx[k] + ((y + dy[k]) * width)] = 0;
+        stack[top++] = x + dx[k] + ((y + dy[k]) * width);
+    }
+    free(stack);
+    return 1;
+}
+
+/* Single blob covering the whole image but a 1 pixel border. */
+static void generate_single(uint8_t *image, int width, int height)
+{
+    int i, j;
+    for(j=0; j<height; j++)
+    {
+        for(i=0; i<width; i++)
+        {
+            image[i + (j*width)] = (i > 0) && (j > 0) && (i < (width-1)) && (j < (height-1));
+        }
+    }
+}
+
+/* Isolated pixels on a grid, as dense as the label type allows. */
+static void generate_tiny(uint8_t *image, int width, int height)
+{
+    int i, j;
+    int pitch = 2;
+    while(((int64_t)((width + pitch - 1) / pitch) * ((height + pitch - 1) / pitch)) >= BLOB_LABEL_MAX)
+    {
+        pitch++;
+    }
+    for(j=0; j<height; j++)
+    {
+        for(i=0; i<width; i++)
+        {
+            image[i + (j*width)] = !(i % pitch) && !(j % pitch);
+        }
+    }
+}
+
+/* Add a workload. The image is allocated but not filled. */
+static workload_t* workload_add(workload_t **workloads, int *count, const char *name, int width, int height)
+{
+    workload_t *w;
+    workload_t *tmp = (workload_t*)realloc(*workloads, (*count + 1) * sizeof(workload_t));
+    if(NULL == tmp)
+    {
+        return NULL;
+    }
+    *workloads = tmp;
+    w = tmp + *count;
+    w->image = (uint8_t*)malloc(width * height);
+    if(NULL == w->image)
+    {
+        return NULL;
+    }
+    snprintf(w->name, sizeof(w->name), "%s", name);
+    w->width  = width;
+    w->height = height;
+    ++*count;
+    return w;
+}
+
+/* Add the thresholded PNG images of a directory. */
+static int workload_add_dir(workload_t **workloads, int *count, const char *path)
+{
+    struct dirent *entry;
+    DIR *dir = opendir(path);
+    if(NULL == dir)
+    {
+        fprintf(stderr, "failed to open %s\n", path);
+        return 0;
+    }
+    while(NULL != (entry = readdir(dir)))
+    {
+        char filename[1024];
+        uint8_t *image;
+        int width, height, i;
+        size_t len = strlen(entry->d_name);
+        workload_t *w;
+
+        if((len < 4) || strcmp(entry->d_name + len - 4, ".png"))
+        {
+            continue;
+        }
+        snprintf(filename, sizeof(filename), "%s/%s", path, entry->d_name);
+        image = stbi_load(filename, &width, &height, NULL, 1);
+        if(NULL == image)
+        {
+            fprintf(stderr, "failed to read image : %s\n", filename);
+            continue;
+        }
+        w = workload_add(workloads, count, entry->d_name, width, height);
+        if(NULL == w)
+        {
+            stbi_image_free(image);
+            closedir(dir);
+            return 0;
+        }
+        for(i=0; i<(width*height); i++)
+        {
+            w->image[i] = (image[i] >= 128) ? 1 : 0;
+        }
+        stbi_image_free(image);
+    }
+    closedir(dir);
+    return 1;
+}
+
+static int compare_time(const void *a, const void *b)
+{
+    int64_t ta = *(const int64_t*)a;
+    int64_t tb = *(const int64_t*)b;
+    return (ta > tb) - (ta < tb);
+}
+
+/* Time a workload and print the results. If ctx is NULL, find_blobs is used. */
+static int bench_run(const workload_t *w, blob_context_t *ctx, int iterations, int64_t *times)
+{
+    int64_t total = 0;
+    size_t allocs;
+    double mpixels;
+    int i, count = 0;
+
+    /* warm up. */
+    if(NULL != ctx)
+    {
+        if( !find_blobs_ctx(ctx, 0, 0, w->width, w->height, w->image, w->width, w->height, BLOB_EXTRACT_INTERNAL) )
+        {
+            return 0;
+        }
+    }
+
+    g_alloc_count = 0;
+    for(i=0; i<iterations; i++)
+    {
+        int64_t start = bench_now();
+        if(NULL != ctx)
+        {
+            if( !find_blobs_ctx(ctx, 0, 0, w->width, w->height, w->image, w->width, w->height, BLOB_EXTRACT_INTERNAL) )
+            {
+                return 0;
+            }
+            count = ctx->count;
+            times[i] = bench_now() - start;
+        }
+        else
+        {
+            label_t *label = NULL;
+            blob_coord_t label_w, label_h;
+            blob_t *blobs = NULL;
+            if( !find_blobs(0, 0, w->width, w->height, w->image, w->width, w->height, &label, &label_w, &label_h, &blobs, &count, 1) )
+            {
+                return 0;
+            }
+            destroy_blobs(blobs, count);
+            free(label);
+            times[i] = bench_now() - start;
+        }
+        total += times[i];
+    }
+    allocs = g_alloc_count;
+
+    qsort(times, iterations, sizeof(int64_t), compare_time);
+    mpixels = ((double)w->width * w->height * iterations) / ((double)total / 1e3);
+    printf("%-20s %-10s %5dx%-5d %8d %10.2f %10.2f %10.3f %10.3f\n",
+           w->name, (NULL != ctx) ? "ctx" : "find_blobs", w->width, w->height, count,
+           mpixels, (double)allocs / iterations,
+           times[iterations / 2] / 1e6, times[((iterations * 99) - 1) / 100] / 1e6);
+    return 1;
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage : blob_bench [options] [dir]\n"
+            "Time the labelling of synthetic images and of the PNG images of a directory "
+            "(default: " BLOB_BENCH_DATA ").\n"
+            "--size or -s       : size of the synthetic images (default: 512).\n"
+            "--iterations or -n : number of calls per workload (default: 50).\n"
+            "--help or -h       : displays this message.\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const int densities[] = { 5, 25, 50, 75, 95 };
+
+    workload_t *workloads = NULL;
+    int workload_count = 0;
+    workload_t *w;
+    blob_context_t ctx;
+    int64_t *times;
+    char name[64];
+    int size = 512;
+    int iterations = 50;
+    int i, ret, failed;
+
+    char *short_options = "s:n:h";
+    struct option long_options[] = {
+        {"size",       1, 0, 's'},
+        {"iterations", 1, 0, 'n'},
+        {"help",       0, 0, 'h'},
+        { 0,           0, 0,  0 }
+    };
+    int idx, opt;
+
+    while ((opt = getopt_long (argc, argv, short_options, long_options, &idx)) > 0)
+    {
+        switch(opt)
+        {
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            default:
+                fprintf(stderr, "error: invalid option\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+    if((size <= 0) || (iterations <= 0) || ((argc - optind) > 1))
+    {
+        fprintf(stderr, "error: invalid parameters\n");
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    ret = EXIT_FAILURE;
+
+    /* synthetic workloads. */
+    for(i=0; i<(int)(sizeof(densities) / sizeof(densities[0])); i++)
+    {
+        snprintf(name, sizeof(name), "noise_%d", densities[i]);
+        if(NULL == (w = workload_add(&workloads, &workload_count, name, size, size))) { goto cleanup; }
+        generate_noise(w->image, size, size, densities[i]);
+    }
+    if(NULL == (w = workload_add(&workloads, &workload_count, "checker_1", size, size))) { goto cleanup; }
+    generate_checker(w->image, size, size, 1);
+    if(NULL == (w = workload_add(&workloads, &workload_count, "checker_8", size, size))) { goto cleanup; }
+    generate_checker(w->image, size, size, 8);
+    if(NULL == (w = workload_add(&workloads, &workload_count, "labyrinth", size, size))) { goto cleanup; }
+    if( !generate_labyrinth(w->image, size, size) ) { goto cleanup; }
+    if(NULL == (w = workload_add(&workloads, &workload_count, "single", size, size))) { goto cleanup; }
+    generate_single(w->image, size, size);
+    if(NULL == (w = workload_add(&workloads, &workload_count, "tiny", size, size))) { goto cleanup; }
+    generate_tiny(w->image, size, size);
+
+    /* real images. */
+    if( !workload_add_dir(&workloads, &workload_count, (optind < argc) ? argv[optind] : BLOB_BENCH_DATA) )
+    {
+        goto cleanup;
+    }
+
+    times = (int64_t*)malloc(iterations * sizeof(int64_t));
+    if(NULL == times)
+    {
+        goto cleanup;
+    }
+
+    printf("%-20s %-10s %11s %8s %10s %10s %10s %10s\n",
+           "workload", "api", "size", "blobs", "Mpixel/s", "allocs", "p50 (ms)", "p99 (ms)");
+    blob_context_init(&ctx);
+    for(i=0, failed=0; i<workload_count; i++)
+    {
+        if( !bench_run(workloads + i, NULL, iterations, times) || !bench_run(workloads + i, &ctx, iterations, times) )
+        {
+            fprintf(stderr, "\nfailed to label %s\n", workloads[i].name);
+            failed = 1;
+        }
+    }
+    blob_context_destroy(&ctx);
+    free(times);
+    if(!failed)
+    {
+        ret = EXIT_SUCCESS;
+    }
+
+cleanup:
+    for(i=0; i<workload_count; i++)
+    {
+        free(workloads[i].image);
+    }
+    free(workloads);
+    return ret;
+}
@@ -0,0 +1,1451 @@
+/* Compares the blobs found by each entry point with the ones of
+ * find_blobs_ctx on random images and ROIs. The images mix noise with
+ * filled and hollow rectangles, so that there are large blobs with holes
+ * and nested blobs. Each entry point is checked with a random combination
+ * of the flags it accepts and random blob filters.
+ *
+ * Usage: blob_check [iterations] [seed]
+ * The seed of a failing iteration is printed, so it can be replayed alone.
+ *
+ * Licensed under the MIT License
+ * (c) 2016-2023 Vincent Cruz
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <blob.h>
+
+/* Which parts of 2 blob lists are compared. */
+#define CHECK_FIELDS    0x01    /* position, holes and features */
+#define CHECK_PERIMETER 0x02    /* perimeter */
+#define CHECK_POINTS    0x04    /* contour points */
+#define CHECK_LABELS    0x08    /* blob labels */
+#define CHECK_TREE      0x10    /* contour tree links */
+#define CHECK_ORDER     0x20    /* same order, otherwise blobs are matched by their first pixel */
+#define CHECK_ALL       0x3f
+#define CHECK_SUBSET    0x40    /* the list may hold more blobs than the reference */
+
+/* Copy of a blob whose contours are decoded. */
+typedef struct
+{
+    int label, x, y, cls;
+    int internal_count;
+    blob_features_t features;
+    int parent, hole, child, sibling;
+    /* Number of stored contours, their point counts and their points. */
+    int contours;
+    int *counts;
+    blob_coord_t *points;
+    int point_count;
+} check_blob_t;
+
+typedef struct
+{
+    check_blob_t *blobs;
+    int count;
+    int capacity;
+} check_list_t;
+
+/* Random image and ROI of an iteration. */
+typedef struct
+{
+    uint8_t *image;
+    int width, height;
+    blob_coord_t roi_x, roi_y, roi_w, roi_h;
+    int min_area, min_perimeter;
+} check_case_t;
+
+/* Blobs or contours passed to a callback. */
+typedef struct
+{
+    check_list_t list;
+    int flags;
+} check_cb_t;
+
+static const char *g_name = "";
+static uint32_t g_seed = 0;
+static int g_failures = 0;
+
+/* Report a failure of the current entry point. */
+#define CHECK_FAIL(...) \
+do { \
+    if(g_failures++ < 20) \
+    { \
+        printf("%s (seed %u): ", g_name, g_seed); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } \
+} while(0)
+
+static void* check_alloc(size_t size)
+{
+    void *ptr = calloc(1, size ? size : 1);
+    if(NULL == ptr)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+/* Simple deterministic random number generator (xorshift32). */
+static uint32_t g_state = 1;
+
+static int check_rand(int n)
+{
+    g_state ^= g_state << 13;
+    g_state ^= g_state >> 17;
+    g_state ^= g_state << 5;
+    return (int)(g_state % (uint32_t)n);
+}
+
+/* Noise with some filled and hollow rectangles, 0 being the background.
+   The foreground pixels are given values in [1, classes]. */
+static void check_generate(uint8_t *image, int width, int height, int classes)
+{
+    int density = check_rand(70);
+    int rects = check_rand(8);
+    int i, j, k;
+    for(i=0; i<(width*height); i++)
+    {
+        image[i] = (check_rand(100) < density) ? (uint8_t)(1 + check_rand(classes)) : 0;
+    }
+    for(k=0; k<rects; k++)
+    {
+        int x0 = check_rand(width);
+        int y0 = check_rand(height);
+        int x1 = x0 + check_rand(width - x0);
+        int y1 = y0 + check_rand(height - y0);
+        int hollow = check_rand(2);
+        uint8_t value = (uint8_t)check_rand(classes + 1);
+        for(j=y0; j<=y1; j++)
+        {
+            for(i=x0; i<=x1; i++)
+            {
+                int edge = (i == x0) || (i == x1) || (j == y0) || (j == y1);
+                image[i + (j*width)] = (!hollow || edge) ? value : 0;
+            }
+        }
+    }
+}
+
+/* Random image and ROI. The ROI may lie partially outside the image. */
+static void check_case(check_case_t *c, int max_w, int max_h)
+{
+    c->width  = 1 + check_rand(max_w);
+    c->height = 1 + check_rand(max_h);
+    c->image  = (uint8_t*)check_alloc(c->width * c->height);
+    check_generate(c->image, c->width, c->height, 1);
+    if(check_rand(4))
+    {
+        c->roi_x = (blob_coord_t)(check_rand(c->width) - check_rand(4));
+        c->roi_y = (blob_coord_t)(check_rand(c->height) - check_rand(4));
+        c->roi_w = (blob_coord_t)(1 + check_rand(c->width + 4));
+        c->roi_h = (blob_coord_t)(1 + check_rand(c->height + 4));
+    }
+    else
+    {
+        c->roi_x = c->roi_y = 0;
+        c->roi_w = (blob_coord_t)c->width;
+        c->roi_h = (blob_coord_t)c->height;
+    }
+    c->min_area      = check_rand(3) ? 0 : check_rand(6);
+    c->min_perimeter = check_rand(3) ? 0 : check_rand(8);
+}
+
+/* Random flags among the ones given, keeping a valid combination. */
+static int check_flags(int allowed)
+{
+    int flags = 0;
+    int bit;
+    for(bit=1; bit<=BLOB_CONTOUR_TREE; bit<<=1)
+    {
+        if((allowed & bit) && !check_rand(3))
+        {
+            flags |= bit;
+        }
+    }
+    if((flags & BLOB_CHAIN_CODES) && (flags & BLOB_SIMPLIFY))
+    {
+        flags &= ~(check_rand(2) ? BLOB_CHAIN_CODES : BLOB_SIMPLIFY);
+    }
+    if(flags & BLOB_TWO_PASS)
+    {
+        flags &= ~(BLOB_EXTRACT_INTERNAL | BLOB_NO_LABELS | BLOB_COUNT_HOLES | BLOB_CONTOUR_TREE);
+    }
+    if((flags & BLOB_COUNT_HOLES) && (flags & (BLOB_EXTRACT_INTERNAL | BLOB_CONTOUR_TREE)))
+    {
+        flags &= ~BLOB_COUNT_HOLES;
+    }
+    return flags;
+}
+
+static void check_context(blob_context_t *ctx, const check_case_t *c, int flags)
+{
+    blob_context_init(ctx);
+    ctx->min_area = c->min_area;
+    ctx->min_perimeter = (flags & BLOB_TWO_PASS) ? 0 : c->min_perimeter;
+}
+
+static void check_contour(check_blob_t *b, const contour_t *contour)
+{
+    int *counts = (int*)check_alloc((b->contours + 1) * sizeof(int));
+    blob_coord_t *points = (blob_coord_t*)check_alloc(2 * (size_t)(b->point_count + contour->count) * sizeof(blob_coord_t));
+    if(b->contours)
+    {
+        memcpy(counts, b->counts, b->contours * sizeof(int));
+        memcpy(points, b->points, 2 * (size_t)b->point_count * sizeof(blob_coord_t));
+    }
+    if(contour->count)
+    {
+        contour_decode(contour, points + (2 * b->point_count));
+    }
+    counts[b->contours++] = contour->count;
+    b->point_count += contour->count;
+    free(b->counts);
+    free(b->points);
+    b->counts = counts;
+    b->points = points;
+}
+
+static check_blob_t* check_push(check_list_t *list)
+{
+    check_blob_t *b;
+    if(list->count >= list->capacity)
+    {
+        check_blob_t *tmp;
+        list->capacity = list->capacity ? (2 * list->capacity) : 16;
+        tmp = (check_blob_t*)realloc(list->blobs, list->capacity * sizeof(check_blob_t));
+        if(NULL == tmp)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        list->blobs = tmp;
+    }
+    b = list->blobs + list->count++;
+    memset(b, 0, sizeof(check_blob_t));
+    return b;
+}
+
+/* Copy a blob and the contours stored with the given flags. */
+static check_blob_t* check_add(check_list_t *list, const blob_t *blob, int flags)
+{
+    check_blob_t *b = check_push(list);
+    int i;
+    b->label = blob->label;
+    b->x = blob->x;
+    b->y = blob->y;
+    b->cls = blob->cls;
+    b->internal_count = blob->internal_count;
+    b->features = blob->features;
+    b->parent = blob->parent;
+    b->hole = blob->hole;
+    b->child = blob->child;
+    b->sibling = blob->sibling;
+    if(!(flags & (BLOB_NO_EXTERNAL_POINTS | BLOB_TWO_PASS)))
+    {
+        check_contour(b, &blob->external);
+    }
+    if(flags & BLOB_EXTRACT_INTERNAL)
+    {
+        for(i=0; i<blob->internal_count; i++)
+        {
+            check_contour(b, blob->internal + i);
+        }
+    }
+    return b;
+}
+
+static void check_list(check_list_t *list, const blob_t *blobs, int count, int flags)
+{
+    int i;
+    for(i=0; i<count; i++)
+    {
+        check_add(list, blobs + i, flags);
+    }
+}
+
+static void check_release(check_list_t *list)
+{
+    int i;
+    for(i=0; i<list->count; i++)
+    {
+        free(list->blobs[i].counts);
+        free(list->blobs[i].points);
+    }
+    free(list->blobs);
+    memset(list, 0, sizeof(check_list_t));
+}
+
+/* Index of the blob starting at (x,y), or -1. */
+static int check_find(const check_list_t *list, int x, int y)
+{
+    int i;
+    for(i=0; i<list->count; i++)
+    {
+        if((list->blobs[i].x == x) && (list->blobs[i].y == y))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void check_blob(const check_blob_t *a, const check_blob_t *b, int what, int flags)
+{
+    if((what & CHECK_LABELS) && (a->label != b->label))
+    {
+        CHECK_FAIL("blob (%d,%d) label %d instead of %d", a->x, a->y, b->label, a->label);
+    }
+    if(what & CHECK_FIELDS)
+    {
+        if((a->internal_count != b->internal_count) || (a->cls != b->cls))
+        {
+            CHECK_FAIL("blob (%d,%d) has %d holes and class %d instead of %d and %d", a->x, a->y, b->internal_count, b->cls, a->internal_count, a->cls);
+        }
+        if(flags & (BLOB_FEATURES | BLOB_SECOND_ORDER))
+        {
+            const blob_features_t *f = &a->features;
+            const blob_features_t *g = &b->features;
+            if((f->area != g->area) || (f->min_x != g->min_x) || (f->min_y != g->min_y) || (f->max_x != g->max_x) || (f->max_y != g->max_y) ||
+               (f->sum_x != g->sum_x) || (f->sum_y != g->sum_y))
+            {
+                CHECK_FAIL("blob (%d,%d) features differ", a->x, a->y);
+            }
+            if((flags & BLOB_SECOND_ORDER) && ((f->sum_xx != g->sum_xx) || (f->sum_yy != g->sum_yy) || (f->sum_xy != g->sum_xy)))
+            {
+                CHECK_FAIL("blob (%d,%d) second order moments differ", a->x, a->y);
+            }
+        }
+    }
+    if((what & CHECK_PERIMETER) && (a->features.perimeter != b->features.perimeter))
+    {
+        CHECK_FAIL("blob (%d,%d) perimeter %d instead of %d", a->x, a->y, b->features.perimeter, a->features.perimeter);
+    }
+    if((what & CHECK_TREE) && (flags & BLOB_CONTOUR_TREE) && ((a->parent != b->parent) || (a->hole != b->hole) || (a->child != b->child) || (a->sibling != b->sibling)))
+    {
+        CHECK_FAIL("blob (%d,%d) tree links differ", a->x, a->y);
+    }
+    if(what & CHECK_POINTS)
+    {
+        if((a->contours != b->contours) || (a->point_count != b->point_count) ||
+           (a->contours && memcmp(a->counts, b->counts, a->contours * sizeof(int))) ||
+           (a->point_count && memcmp(a->points, b->points, 2 * (size_t)a->point_count * sizeof(blob_coord_t))))
+        {
+            CHECK_FAIL("blob (%d,%d) contours differ", a->x, a->y);
+        }
+    }
+}
+
+/* Compare a list of blobs with the reference one. */
+static void check_compare(const check_list_t *ref, const check_list_t *list, int what, int flags)
+{
+    int i;
+    if((ref->count != list->count) && !((what & CHECK_SUBSET) && (ref->count < list->count)))
+    {
+        CHECK_FAIL("%d blobs instead of %d", list->count, ref->count);
+        return;
+    }
+    for(i=0; i<ref->count; i++)
+    {
+        const check_blob_t *a = ref->blobs + i;
+        int k = i;
+        if(!(what & CHECK_ORDER))
+        {
+            k = check_find(list, a->x, a->y);
+            if(k < 0)
+            {
+                CHECK_FAIL("blob (%d,%d) is missing", a->x, a->y);
+                continue;
+            }
+        }
+        else if((a->x != list->blobs[k].x) || (a->y != list->blobs[k].y))
+        {
+            CHECK_FAIL("blob %d starts at (%d,%d) instead of (%d,%d)", k, list->blobs[k].x, list->blobs[k].y, a->x, a->y);
+            continue;
+        }
+        check_blob(a, list->blobs + k, what, flags);
+    }
+}
+
+/* Compare the labels of the foreground pixels. The blobs of both lists are
+   matched by their first pixel. The pixels of the discarded blobs are
+   skipped. If strict is set, the pixels not labelled in the reference must
+   not be labelled either. */
+static void check_labels(const label_t *ref, int ref_stride, const check_list_t *ref_list,
+                         const label_t *label, int label_stride, const check_list_t *list,
+                         int w, int h, int strict)
+{
+    int *map;
+    int max_label = 0;
+    int i, j;
+    for(i=0; i<ref_list->count; i++)
+    {
+        if(ref_list->blobs[i].label > max_label)
+        {
+            max_label = ref_list->blobs[i].label;
+        }
+    }
+    map = (int*)check_alloc((max_label + 1) * sizeof(int));
+    for(i=0; i<ref_list->count; i++)
+    {
+        int k = check_find(list, ref_list->blobs[i].x, ref_list->blobs[i].y);
+        map[ref_list->blobs[i].label] = (k < 0) ? 0 : list->blobs[k].label;
+    }
+    for(j=0; j<h; j++)
+    {
+        for(i=0; i<w; i++)
+        {
+            int r = ref[i + (j*ref_stride)];
+            int l = label[i + (j*label_stride)];
+            if(r > 0)
+            {
+                if((r <= max_label) && map[r] && (l != map[r]))
+                {
+                    CHECK_FAIL("pixel (%d,%d) of the ROI is labelled %d instead of %d", i, j, l, map[r]);
+                    free(map);
+                    return;
+                }
+            }
+            else if(strict && (l > 0))
+            {
+                CHECK_FAIL("background pixel (%d,%d) of the ROI is labelled %d", i, j, l);
+                free(map);
+                return;
+            }
+        }
+    }
+    free(map);
+}
+
+/* Reference labelling. */
+static void check_reference(blob_context_t *ref, check_list_t *list, const check_case_t *c, uint8_t *image, int flags)
+{
+    check_context(ref, c, flags);
+    if( !find_blobs_ctx(ref, c->roi_x, c->roi_y, c->roi_w, c->roi_h, image, (blob_coord_t)c->width, (blob_coord_t)c->height, flags) )
+    {
+        CHECK_FAIL("find_blobs_ctx failed (flags %x)", flags);
+    }
+    check_list(list, ref->blobs, ref->count, flags);
+}
+
+/* Compare a context with the reference, the blobs being in raster order. */
+static void check_result(const blob_context_t *ref, const check_list_t *ref_list, const blob_context_t *ctx, int what, int flags, int strict)
+{
+    check_list_t list = { NULL, 0, 0 };
+    check_list(&list, ctx->blobs, ctx->count, flags);
+    check_compare(ref_list, &list, what, flags);
+    if((ctx->label_w != ref->label_w) || (ctx->label_h != ref->label_h))
+    {
+        CHECK_FAIL("label buffer is %dx%d instead of %dx%d", ctx->label_w, ctx->label_h, ref->label_w, ref->label_h);
+    }
+    else if(!(flags & BLOB_NO_LABELS) && (ref->label_w > 0))
+    {
+        check_labels(ref->label, ref->label_w, ref_list, ctx->label, ctx->label_w, &list, ref->label_w, ref->label_h, strict);
+    }
+    check_release(&list);
+}
+
+#define CHECK_TRACE_FLAGS (BLOB_EXTRACT_INTERNAL | BLOB_NO_EXTERNAL_POINTS | BLOB_NO_LABELS | BLOB_FEATURES | BLOB_SECOND_ORDER | \
+                           BLOB_CHAIN_CODES | BLOB_ERASE_FILTERED | BLOB_COUNT_HOLES | BLOB_SIMPLIFY)
+#define CHECK_ALL_FLAGS   (CHECK_TRACE_FLAGS | BLOB_TWO_PASS | BLOB_CONTOUR_TREE)
+
+static void check_mt(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_ALL_FLAGS);
+    blob_context_t ref, ctx;
+    check_list_t list = { NULL, 0, 0 };
+    g_name = "find_blobs_mt_ctx";
+    check_reference(&ref, &list, c, c->image, flags);
+    check_context(&ctx, c, flags);
+    if(check_rand(2))
+    {
+        /* The workers of a batch, with other blob filters, are reused for the strips. */
+        blob_job_t jobs[4];
+        int k;
+        for(k=0; k<4; k++)
+        {
+            memset(jobs + k, 0, sizeof(blob_job_t));
+            jobs[k].in = c->image;
+            jobs[k].in_w = jobs[k].roi_w = (blob_coord_t)c->width;
+            jobs[k].in_h = jobs[k].roi_h = (blob_coord_t)c->height;
+        }
+        ctx.min_area += 2;
+        ctx.min_perimeter += 3;
+        if( !find_blobs_batch_ctx(&ctx, jobs, 4, 0, 4) )
+        {
+            CHECK_FAIL("find_blobs_batch_ctx failed");
+        }
+        ctx.min_area -= 2;
+        ctx.min_perimeter -= 3;
+    }
+    if( !find_blobs_mt_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, c->image, (blob_coord_t)c->width, (blob_coord_t)c->height, flags, 1 + check_rand(6)) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    /* The background pixels marked with -1 may differ near the strip boundaries. */
+    check_result(&ref, &list, &ctx, CHECK_ALL, flags, 1);
+    check_release(&list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+}
+
+static void check_1bpp(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_ALL_FLAGS);
+    int stride = ((c->width + 7) / 8) + check_rand(3);
+    uint8_t *bits = (uint8_t*)check_alloc((size_t)stride * c->height);
+    blob_context_t ref, ctx;
+    check_list_t list = { NULL, 0, 0 };
+    int i, j;
+    g_name = "find_blobs_1bpp_ctx";
+    for(j=0; j<c->height; j++)
+    {
+        for(i=0; i<c->width; i++)
+        {
+            if(c->image[i + (j*c->width)])
+            {
+                bits[(i/8) + (j*stride)] |= (uint8_t)(0x80 >> (i%8));
+            }
+        }
+    }
+    check_reference(&ref, &list, c, c->image, flags);
+    check_context(&ctx, c, flags);
+    if( !find_blobs_1bpp_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, bits, (blob_coord_t)c->width, (blob_coord_t)c->height, stride, flags) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    check_result(&ref, &list, &ctx, CHECK_ALL, flags, 1);
+    check_release(&list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+    free(bits);
+}
+
+static void check_rle(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_ALL_FLAGS);
+    blob_run_t *runs = (blob_run_t*)check_alloc((size_t)c->width * c->height * sizeof(blob_run_t));
+    int *rows = (int*)check_alloc((c->height + 1) * sizeof(int));
+    blob_context_t ref, ctx;
+    check_list_t list = { NULL, 0, 0 };
+    int i, j, n;
+    g_name = "find_blobs_rle_ctx";
+    for(j=0, n=0; j<c->height; j++)
+    {
+        const uint8_t *row = c->image + (j*c->width);
+        rows[j] = n;
+        for(i=0; i<c->width; )
+        {
+            int x = i;
+            while((i < c->width) && row[i])
+            {
+                i++;
+            }
+            if(i > x)
+            {
+                runs[n].x = (blob_coord_t)x;
+                runs[n].length = (blob_coord_t)(i - x);
+                n++;
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+    rows[c->height] = n;
+    check_reference(&ref, &list, c, c->image, flags);
+    check_context(&ctx, c, flags);
+    if( !find_blobs_rle_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, runs, rows, (blob_coord_t)c->width, (blob_coord_t)c->height, flags) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    check_result(&ref, &list, &ctx, CHECK_ALL, flags, 1);
+    check_release(&list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+    free(rows);
+    free(runs);
+}
+
+static void check_batch(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_ALL_FLAGS);
+    blob_job_t jobs[4];
+    int count = 1 + check_rand(4);
+    blob_context_t ctx;
+    int k;
+    g_name = "find_blobs_batch_ctx";
+    for(k=0; k<count; k++)
+    {
+        jobs[k].in = c->image;
+        jobs[k].in_w = (blob_coord_t)c->width;
+        jobs[k].in_h = (blob_coord_t)c->height;
+        jobs[k].roi_x = (blob_coord_t)check_rand(c->width);
+        jobs[k].roi_y = (blob_coord_t)check_rand(c->height);
+        jobs[k].roi_w = (blob_coord_t)(1 + check_rand(c->width));
+        jobs[k].roi_h = (blob_coord_t)(1 + check_rand(c->height));
+    }
+    check_context(&ctx, c, flags);
+    if( !find_blobs_batch_ctx(&ctx, jobs, count, flags, 1 + check_rand(3)) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    for(k=0; k<count; k++)
+    {
+        check_case_t sub = *c;
+        blob_context_t ref;
+        check_list_t ref_list = { NULL, 0, 0 }, list = { NULL, 0, 0 };
+        sub.roi_x = jobs[k].roi_x;
+        sub.roi_y = jobs[k].roi_y;
+        sub.roi_w = jobs[k].roi_w;
+        sub.roi_h = jobs[k].roi_h;
+        check_reference(&ref, &ref_list, &sub, c->image, flags);
+        if( !jobs[k].status )
+        {
+            CHECK_FAIL("job %d failed (flags %x)", k, flags);
+        }
+        else
+        {
+            check_list(&list, jobs[k].blobs, jobs[k].count, flags);
+            check_compare(&ref_list, &list, CHECK_ALL, flags);
+        }
+        check_release(&list);
+        check_release(&ref_list);
+        blob_context_destroy(&ref);
+    }
+    blob_context_destroy(&ctx);
+}
+
+/* Clamp a ROI like the library does. */
+static void check_clamp(const check_case_t *c, int *x, int *y, int *w, int *h)
+{
+    *x = c->roi_x; *y = c->roi_y;
+    *w = c->roi_w; *h = c->roi_h;
+    if((*x >= c->width) || (*y >= c->height))
+    {
+        *w = *h = 0;
+        return;
+    }
+    if(*x < 0) { *x = 0; }
+    if(*y < 0) { *y = 0; }
+    if((*x + *w) > c->width)  { *w = c->width - *x; }
+    if((*y + *h) > c->height) { *h = c->height - *y; }
+    if((*w <= 0) || (*h <= 0))
+    {
+        *w = *h = 0;
+    }
+}
+
+/* Padded input and caller owned label buffer. With BLOB_PADDED, the pixels
+   around the ROI are cleared in both the input and the reference image. */
+static void check_stride(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_ALL_FLAGS);
+    int in_stride = c->width + check_rand(5);
+    uint8_t *image = (uint8_t*)check_alloc(c->width * c->height);
+    uint8_t *padded = (uint8_t*)check_alloc((size_t)in_stride * c->height);
+    label_t *label = NULL;
+    int label_stride = 0;
+    blob_context_t ref, ctx;
+    check_list_t ref_list = { NULL, 0, 0 }, list = { NULL, 0, 0 };
+    int x, y, w, h, i, j;
+    g_name = "find_blobs_stride_ctx";
+
+    memcpy(image, c->image, c->width * c->height);
+    check_clamp(c, &x, &y, &w, &h);
+    if((w > 0) && (x > 0) && (y > 0) && ((x + w) < c->width) && ((y + h) < c->height) && check_rand(2))
+    {
+        flags |= BLOB_PADDED;
+        for(j=y-1; j<=(y+h); j++)
+        {
+            for(i=x-1; i<=(x+w); i++)
+            {
+                if((i < x) || (j < y) || (i >= (x+w)) || (j >= (y+h)))
+                {
+                    image[i + (j*c->width)] = 0;
+                }
+            }
+        }
+    }
+    for(j=0; j<c->height; j++)
+    {
+        memcpy(padded + (j*in_stride), image + (j*c->width), c->width);
+    }
+    check_reference(&ref, &ref_list, c, image, flags & ~BLOB_PADDED);
+    check_context(&ctx, c, flags);
+    if(check_rand(4))
+    {
+        /* The labels of the ROI are stored at (1,1) of a larger buffer. */
+        label_stride = w + 2 + check_rand(3);
+        label = (label_t*)check_alloc((size_t)label_stride * (h + 2) * sizeof(label_t));
+    }
+    if( !find_blobs_stride_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, padded, (blob_coord_t)c->width, (blob_coord_t)c->height, in_stride,
+                               label ? (label + 1 + label_stride) : NULL, label_stride, flags) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    if(NULL == label)
+    {
+        check_result(&ref, &ref_list, &ctx, CHECK_ALL, flags, 1);
+    }
+    else
+    {
+        check_list(&list, ctx.blobs, ctx.count, flags);
+        check_compare(&ref_list, &list, CHECK_ALL, flags);
+        if(!(flags & BLOB_NO_LABELS) && (w > 0))
+        {
+            check_labels(ref.label, ref.label_w, &ref_list, label + 1 + label_stride, label_stride, &list, w, h, 1);
+        }
+    }
+    check_release(&list);
+    check_release(&ref_list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+    free(label);
+    free(padded);
+    free(image);
+}
+
+static void check_range(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_ALL_FLAGS);
+    int size = c->width * c->height;
+    uint8_t *gray = (uint8_t*)check_alloc(size);
+    uint8_t *mask = (uint8_t*)check_alloc(size);
+    int lo = check_rand(256);
+    int hi = lo + check_rand(256 - lo);
+    blob_context_t ref, ctx;
+    check_list_t list = { NULL, 0, 0 };
+    int i;
+    g_name = "find_blobs_range_ctx";
+    for(i=0; i<size; i++)
+    {
+        /* Keep the shapes of the image, with some noise. */
+        gray[i] = c->image[i] ? (uint8_t)(lo + check_rand(hi - lo + 1)) : (uint8_t)check_rand(256);
+        mask[i] = (gray[i] >= lo) && (gray[i] <= hi);
+    }
+    check_reference(&ref, &list, c, mask, flags);
+    check_context(&ctx, c, flags);
+    if( !find_blobs_range_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, gray, (blob_coord_t)c->width, (blob_coord_t)c->height, 0,
+                              (uint8_t)lo, (uint8_t)hi, flags) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    check_result(&ref, &list, &ctx, CHECK_ALL, flags, 1);
+    check_release(&list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+    free(mask);
+    free(gray);
+}
+
+static int check_raster_order(const void *a, const void *b)
+{
+    const check_blob_t *u = (const check_blob_t*)a;
+    const check_blob_t *v = (const check_blob_t*)b;
+    if(u->y != v->y)
+    {
+        return u->y - v->y;
+    }
+    return u->x - v->x;
+}
+
+/* Each class is compared with the labelling of its own mask. */
+static void check_class(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_TRACE_FLAGS & ~BLOB_COUNT_HOLES);
+    int size = c->width * c->height;
+    uint8_t *classes = (uint8_t*)check_alloc(size);
+    uint8_t *mask = (uint8_t*)check_alloc(size);
+    blob_context_t ctx;
+    check_list_t ref_list = { NULL, 0, 0 }, list = { NULL, 0, 0 };
+    int i, k;
+    g_name = "find_blobs_class_ctx";
+    check_generate(classes, c->width, c->height, 3);
+    check_context(&ctx, c, flags);
+    if( !find_blobs_class_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, classes, (blob_coord_t)c->width, (blob_coord_t)c->height, 0, flags) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    check_list(&list, ctx.blobs, ctx.count, flags);
+    for(k=1; k<=3; k++)
+    {
+        blob_context_t ref;
+        check_list_t class_list = { NULL, 0, 0 };
+        for(i=0; i<size; i++)
+        {
+            mask[i] = (classes[i] == k);
+        }
+        check_reference(&ref, &class_list, c, mask, flags);
+        for(i=0; i<class_list.count; i++)
+        {
+            check_blob_t *b = check_push(&ref_list);
+            *b = class_list.blobs[i];
+            b->cls = k;
+        }
+        if(!(flags & BLOB_NO_LABELS) && (ref.label_w > 0))
+        {
+            check_labels(ref.label, ref.label_w, &class_list, ctx.label, ctx.label_w, &list, ref.label_w, ref.label_h, 0);
+        }
+        /* The contours now belong to ref_list. */
+        free(class_list.blobs);
+        blob_context_destroy(&ref);
+    }
+    if(ref_list.count > 0)
+    {
+        qsort(ref_list.blobs, ref_list.count, sizeof(check_blob_t), check_raster_order);
+    }
+    check_compare(&ref_list, &list, CHECK_ALL & ~(CHECK_LABELS | CHECK_TREE), flags);
+    check_release(&list);
+    check_release(&ref_list);
+    blob_context_destroy(&ctx);
+    free(mask);
+    free(classes);
+}
+
+/* The contours are matched with the reference blobs by their first pixel. */
+static int check_cb_contour(const blob_t *blob, const contour_t *contour, int internal, void *user)
+{
+    check_cb_t *cb = (check_cb_t*)user;
+    int k = check_find(&cb->list, blob->x, blob->y);
+    if(!internal)
+    {
+        if(k >= 0)
+        {
+            CHECK_FAIL("blob (%d,%d) has several external contours", blob->x, blob->y);
+        }
+        k = cb->list.count;
+        check_push(&cb->list);
+        cb->list.blobs[k].x = blob->x;
+        cb->list.blobs[k].y = blob->y;
+        if(!(cb->flags & BLOB_NO_EXTERNAL_POINTS))
+        {
+            check_contour(cb->list.blobs + k, contour);
+        }
+    }
+    else if(k < 0)
+    {
+        CHECK_FAIL("hole of blob (%d,%d) before its external contour", blob->x, blob->y);
+    }
+    else if(cb->flags & BLOB_EXTRACT_INTERNAL)
+    {
+        check_contour(cb->list.blobs + k, contour);
+    }
+    return 1;
+}
+
+static void check_cb(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_TRACE_FLAGS);
+    blob_context_t ref, ctx;
+    check_list_t ref_list = { NULL, 0, 0 };
+    check_cb_t cb;
+    g_name = "find_blobs_cb";
+    memset(&cb, 0, sizeof(cb));
+    cb.flags = flags;
+    check_reference(&ref, &ref_list, c, c->image, flags);
+    check_context(&ctx, c, flags);
+    if( !find_blobs_cb(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, c->image, (blob_coord_t)c->width, (blob_coord_t)c->height, flags, check_cb_contour, &cb) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    /* The blobs of the context have no contour points. */
+    check_result(&ref, &ref_list, &ctx, CHECK_ALL & ~CHECK_POINTS, (flags | BLOB_NO_EXTERNAL_POINTS) & ~BLOB_EXTRACT_INTERNAL, 1);
+    /* The blobs discarded by their area are passed to the callback too. */
+    check_compare(&ref_list, &cb.list, CHECK_POINTS | CHECK_SUBSET, flags);
+    check_release(&cb.list);
+    check_release(&ref_list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+}
+
+static void check_stream_blob(const blob_t *blob, void *user)
+{
+    check_cb_t *cb = (check_cb_t*)user;
+    check_add(&cb->list, blob, cb->flags);
+}
+
+/* The whole image is pushed in chunks of random heights. */
+static void check_stream(const check_case_t *c)
+{
+    int flags = check_flags((CHECK_TRACE_FLAGS & ~BLOB_ERASE_FILTERED) | BLOB_TWO_PASS);
+    check_case_t whole = *c;
+    blob_context_t ref;
+    blob_stream_t stream;
+    check_list_t ref_list = { NULL, 0, 0 };
+    check_cb_t cb;
+    int y, count;
+    g_name = "blob_stream";
+    memset(&cb, 0, sizeof(cb));
+    cb.flags = flags & ~BLOB_NO_LABELS;
+    whole.roi_x = whole.roi_y = 0;
+    whole.roi_w = (blob_coord_t)c->width;
+    whole.roi_h = (blob_coord_t)c->height;
+    check_reference(&ref, &ref_list, &whole, c->image, cb.flags);
+
+    blob_stream_init(&stream);
+    stream.ctx.min_area = c->min_area;
+    stream.ctx.min_perimeter = (flags & BLOB_TWO_PASS) ? 0 : c->min_perimeter;
+    if( !blob_stream_begin(&stream, (blob_coord_t)c->width, flags, check_stream_blob, &cb) )
+    {
+        CHECK_FAIL("blob_stream_begin failed (flags %x)", flags);
+    }
+    for(y=0; y<c->height; y+=count)
+    {
+        count = 1 + check_rand(c->height - y);
+        if( !blob_stream_push_rows(&stream, c->image + (y*c->width), count, c->width) )
+        {
+            CHECK_FAIL("blob_stream_push_rows failed (flags %x)", flags);
+            break;
+        }
+    }
+    if( !blob_stream_finish(&stream) )
+    {
+        CHECK_FAIL("blob_stream_finish failed (flags %x)", flags);
+    }
+    /* Blobs are reported when they are closed, with their own labels. */
+    check_compare(&ref_list, &cb.list, CHECK_FIELDS | CHECK_PERIMETER | CHECK_POINTS, cb.flags);
+    blob_stream_destroy(&stream);
+    check_release(&cb.list);
+    check_release(&ref_list);
+    blob_context_destroy(&ref);
+}
+
+/* A few frames, each one changing some rectangles of the previous one. */
+static void check_update(const check_case_t *c)
+{
+    int flags = check_flags(BLOB_EXTRACT_INTERNAL | BLOB_NO_EXTERNAL_POINTS | BLOB_SECOND_ORDER | BLOB_CHAIN_CODES | BLOB_COUNT_HOLES | BLOB_SIMPLIFY);
+    check_case_t frame = *c;
+    uint8_t *image = (uint8_t*)check_alloc(c->width * c->height);
+    uint8_t *noise = (uint8_t*)check_alloc(c->width * c->height);
+    blob_context_t ctx;
+    int f, k, i, j;
+    g_name = "find_blobs_update_ctx";
+    memcpy(image, c->image, c->width * c->height);
+    frame.min_area = frame.min_perimeter = 0;
+    check_context(&ctx, &frame, flags);
+    for(f=0; f<4; f++)
+    {
+        blob_rect_t dirty[4];
+        int dirty_count = 0;
+        blob_context_t ref;
+        check_list_t ref_list = { NULL, 0, 0 }, list = { NULL, 0, 0 };
+        if(f > 0)
+        {
+            check_generate(noise, c->width, c->height, 1);
+            dirty_count = 1 + check_rand(4);
+            for(k=0; k<dirty_count; k++)
+            {
+                int x0 = check_rand(c->width) - 1;
+                int y0 = check_rand(c->height) - 1;
+                dirty[k].x = (blob_coord_t)x0;
+                dirty[k].y = (blob_coord_t)y0;
+                dirty[k].w = (blob_coord_t)(1 + check_rand(c->width / 2 + 2));
+                dirty[k].h = (blob_coord_t)(1 + check_rand(c->height / 2 + 2));
+                for(j=y0; j<(y0 + dirty[k].h); j++)
+                {
+                    for(i=x0; i<(x0 + dirty[k].w); i++)
+                    {
+                        if((i >= 0) && (j >= 0) && (i < c->width) && (j < c->height))
+                        {
+                            image[i + (j*c->width)] = noise[i + (j*c->width)];
+                        }
+                    }
+                }
+            }
+        }
+        check_reference(&ref, &ref_list, &frame, image, flags | BLOB_FEATURES);
+        if( !find_blobs_update_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, image, (blob_coord_t)c->width, (blob_coord_t)c->height,
+                                   (f > 0) ? dirty : NULL, dirty_count, flags) )
+        {
+            CHECK_FAIL("failed (flags %x)", flags);
+        }
+        /* The blobs are not in raster order anymore, and only the foreground labels are kept. */
+        check_list(&list, ctx.blobs, ctx.count, flags | BLOB_FEATURES);
+        check_compare(&ref_list, &list, CHECK_FIELDS | CHECK_PERIMETER | CHECK_POINTS, flags | BLOB_FEATURES);
+        if(ref.label_w > 0)
+        {
+            check_labels(ref.label, ref.label_w, &ref_list, ctx.label, ctx.label_w, &list, ref.label_w, ref.label_h, 0);
+        }
+        check_release(&list);
+        check_release(&ref_list);
+        blob_context_destroy(&ref);
+    }
+    blob_context_destroy(&ctx);
+    free(noise);
+    free(image);
+}
+
+/* The two-pass labelling is compared with the contour tracing. */
+static void check_two_pass(const check_case_t *c)
+{
+    int flags = check_flags(BLOB_FEATURES | BLOB_SECOND_ORDER | BLOB_ERASE_FILTERED) | BLOB_TWO_PASS;
+    blob_context_t ref, ctx;
+    check_list_t list = { NULL, 0, 0 };
+    check_case_t unfiltered = *c;
+    g_name = "BLOB_TWO_PASS";
+    unfiltered.min_perimeter = 0;
+    check_reference(&ref, &list, &unfiltered, c->image, (flags & ~BLOB_TWO_PASS) | BLOB_NO_EXTERNAL_POINTS);
+    check_context(&ctx, c, flags);
+    if( !find_blobs_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, c->image, (blob_coord_t)c->width, (blob_coord_t)c->height, flags) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    /* No contour is traced, so the background is not marked with -1. */
+    check_result(&ref, &list, &ctx, CHECK_FIELDS | CHECK_LABELS | CHECK_ORDER, flags, 1);
+    check_release(&list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+}
+
+/* The contour tree is checked against the 4-connected background regions
+   of the ROI. The parent of a blob is the blob around the region above its
+   first pixel, and its hole is the one traced from the pixel above the
+   first pixel of this region. */
+static void check_tree(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_TRACE_FLAGS & ~BLOB_COUNT_HOLES) | BLOB_CONTOUR_TREE;
+    blob_context_t ref, ctx;
+    check_list_t ref_list = { NULL, 0, 0 }, list = { NULL, 0, 0 };
+    int *region, *first, *stack, *index;
+    int x, y, w, h, i, k, n, max_label;
+    g_name = "BLOB_CONTOUR_TREE";
+
+    check_reference(&ref, &ref_list, c, c->image, flags & ~BLOB_CONTOUR_TREE);
+    check_context(&ctx, c, flags);
+    if( !find_blobs_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, c->image, (blob_coord_t)c->width, (blob_coord_t)c->height, flags) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    check_result(&ref, &ref_list, &ctx, CHECK_ALL & ~CHECK_TREE, flags, 1);
+    check_list(&list, ctx.blobs, ctx.count, flags);
+
+    check_clamp(c, &x, &y, &w, &h);
+    region = (int*)check_alloc(((size_t)w * h + 1) * sizeof(int));
+    first  = (int*)check_alloc(((size_t)w * h + 1) * sizeof(int));
+    stack  = (int*)check_alloc(((size_t)w * h + 1) * sizeof(int));
+    /* Region 0 is the background touching the ROI border. */
+    for(i=0; i<(w*h); i++)
+    {
+        region[i] = -1;
+    }
+    for(i=0, n=1; i<(w*h); i++)
+    {
+        int top = 0, outer = 0, r = n;
+        if(c->image[x + (i%w) + ((y + (i/w)) * c->width)] || (region[i] >= 0))
+        {
+            continue;
+        }
+        first[n++] = i;
+        stack[top++] = i;
+        region[i] = r;
+        while(top > 0)
+        {
+            int p = stack[--top];
+            int px = p % w, py = p / w;
+            int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+            if((px == 0) || (py == 0) || (px == (w-1)) || (py == (h-1)))
+            {
+                outer = 1;
+            }
+            for(k=0; k<4; k++)
+            {
+                int qx = px + dx[k], qy = py + dy[k];
+                int q = qx + (qy*w);
+                if((qx >= 0) && (qy >= 0) && (qx < w) && (qy < h) && (region[q] < 0) && !c->image[x + qx + ((y + qy) * c->width)])
+                {
+                    region[q] = r;
+                    stack[top++] = q;
+                }
+            }
+        }
+        if(outer)
+        {
+            n--;
+            for(k=i; k<(w*h); k++)
+            {
+                if(region[k] == r)
+                {
+                    region[k] = 0;
+                }
+            }
+        }
+    }
+
+    for(i=0, max_label=0; i<list.count; i++)
+    {
+        max_label = (list.blobs[i].label > max_label) ? list.blobs[i].label : max_label;
+    }
+    index = (int*)check_alloc((max_label + 1) * sizeof(int));
+    for(i=0; i<=max_label; i++)
+    {
+        index[i] = -1;
+    }
+    for(i=0; i<list.count; i++)
+    {
+        index[list.blobs[i].label] = i;
+    }
+    for(i=0; i<list.count; i++)
+    {
+        const check_blob_t *b = list.blobs + i;
+        int bx = b->x - x, by = b->y - y;
+        int r = (by > 0) ? region[bx + ((by - 1) * w)] : 0;
+        int expected = -1;
+        if(r > 0)
+        {
+            /* The pixel above the region belongs to the blob around it, unless it was discarded. */
+            int l = ctx.label[first[r] - w];
+            if((l <= 0) || (l > max_label) || (index[l] < 0))
+            {
+                continue;
+            }
+            expected = index[l];
+        }
+        if(b->parent != expected)
+        {
+            CHECK_FAIL("parent of blob %d is %d instead of %d", i, b->parent, expected);
+            continue;
+        }
+        if(expected < 0)
+        {
+            if(b->hole != -1)
+            {
+                CHECK_FAIL("blob %d has no parent but a hole %d", i, b->hole);
+            }
+            continue;
+        }
+        if((b->hole < 0) || (b->hole >= list.blobs[expected].internal_count))
+        {
+            CHECK_FAIL("blob %d lies in hole %d of blob %d which has %d holes", i, b->hole, expected, list.blobs[expected].internal_count);
+        }
+        else if(flags & BLOB_EXTRACT_INTERNAL)
+        {
+            const contour_t *hole = ctx.blobs[expected].internal + b->hole;
+            blob_coord_t p[2] = { 0, 0 };
+            if(hole->count > 0)
+            {
+                p[0] = hole->points[0];
+                p[1] = hole->points[1];
+            }
+            if((hole->count <= 0) || ((p[0] - x) != (first[r] % w)) || ((p[1] - y) != ((first[r] / w) - 1)))
+            {
+                CHECK_FAIL("blob %d does not lie in hole %d of blob %d", i, b->hole, expected);
+            }
+        }
+    }
+    /* Each blob is linked once from its parent, or from the first blob. */
+    for(i=0; i<list.count; i++)
+    {
+        int parent = list.blobs[i].parent;
+        int found = 0;
+        n = 0;
+        for(k=(parent < 0) ? 0 : list.blobs[parent].child; (k >= 0) && (k < list.count); k=list.blobs[k].sibling)
+        {
+            found += (k == i);
+            if(++n > (list.count * list.count))
+            {
+                break;
+            }
+        }
+        if(1 != found)
+        {
+            CHECK_FAIL("blob %d is linked %d times", i, found);
+        }
+    }
+    free(index);
+    free(stack);
+    free(first);
+    free(region);
+    check_release(&list);
+    check_release(&ref_list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+}
+
+/* The features are compared with sums over the 8-connected components of
+   the ROI, found by a flood fill. A blob is matched with the component
+   holding its first pixel. */
+static void check_features(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_ALL_FLAGS) | BLOB_SECOND_ORDER;
+    blob_context_t ctx;
+    int *visited, *stack;
+    int x, y, w, h, i, k, found;
+    g_name = "BLOB_SECOND_ORDER";
+
+    check_context(&ctx, c, flags);
+    if( !find_blobs_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, c->image, (blob_coord_t)c->width, (blob_coord_t)c->height, flags) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    check_clamp(c, &x, &y, &w, &h);
+    visited = (int*)check_alloc(((size_t)w * h + 1) * sizeof(int));
+    stack   = (int*)check_alloc(((size_t)w * h + 1) * sizeof(int));
+    for(i=0, found=0; i<(w*h); i++)
+    {
+        blob_features_t f;
+        int top = 0;
+        if(!c->image[x + (i%w) + ((y + (i/w)) * c->width)] || visited[i])
+        {
+            continue;
+        }
+        memset(&f, 0, sizeof(f));
+        f.min_x = f.max_x = (blob_coord_t)(x + (i%w));
+        f.min_y = f.max_y = (blob_coord_t)(y + (i/w));
+        stack[top++] = i;
+        visited[i] = 1;
+        while(top > 0)
+        {
+            int p = stack[--top];
+            int64_t px = x + (p % w), py = y + (p / w);
+            int dx, dy;
+            f.area++;
+            f.sum_x += px;
+            f.sum_y += py;
+            f.sum_xx += px * px;
+            f.sum_yy += py * py;
+            f.sum_xy += px * py;
+            if(px < f.min_x) { f.min_x = (blob_coord_t)px; }
+            if(py < f.min_y) { f.min_y = (blob_coord_t)py; }
+            if(px > f.max_x) { f.max_x = (blob_coord_t)px; }
+            if(py > f.max_y) { f.max_y = (blob_coord_t)py; }
+            for(dy=-1; dy<=1; dy++)
+            {
+                for(dx=-1; dx<=1; dx++)
+                {
+                    int qx = (p % w) + dx, qy = (p / w) + dy;
+                    int q = qx + (qy*w);
+                    if((qx >= 0) && (qy >= 0) && (qx < w) && (qy < h) && !visited[q] && c->image[x + qx + ((y + qy) * c->width)])
+                    {
+                        visited[q] = 1;
+                        stack[top++] = q;
+                    }
+                }
+            }
+        }
+        for(k=0; k<ctx.count; k++)
+        {
+            if((ctx.blobs[k].x == (x + (i%w))) && (ctx.blobs[k].y == (y + (i/w))))
+            {
+                break;
+            }
+        }
+        if(k >= ctx.count)
+        {
+            /* The component may only be discarded by the blob filters. */
+            if((f.area >= ctx.min_area) && (0 == ctx.min_perimeter))
+            {
+                CHECK_FAIL("blob (%d,%d) is missing", x + (i%w), y + (i/w));
+            }
+        }
+        else
+        {
+            const blob_features_t *g = &ctx.blobs[k].features;
+            found++;
+            if((f.area != g->area) || (f.min_x != g->min_x) || (f.min_y != g->min_y) || (f.max_x != g->max_x) || (f.max_y != g->max_y))
+            {
+                CHECK_FAIL("blob (%d,%d) area or bounding box differ", x + (i%w), y + (i/w));
+            }
+            else if((f.sum_x != g->sum_x) || (f.sum_y != g->sum_y) || (f.sum_xx != g->sum_xx) || (f.sum_yy != g->sum_yy) || (f.sum_xy != g->sum_xy))
+            {
+                CHECK_FAIL("blob (%d,%d) moments differ", x + (i%w), y + (i/w));
+            }
+        }
+    }
+    if(found != ctx.count)
+    {
+        CHECK_FAIL("%d blobs instead of %d", ctx.count, found);
+    }
+    free(stack);
+    free(visited);
+    blob_context_destroy(&ctx);
+}
+
+/* The contours stored as chain codes are decoded and compared with the
+   points stored without BLOB_CHAIN_CODES. */
+static void check_chain_codes(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_TRACE_FLAGS & ~(BLOB_CHAIN_CODES | BLOB_SIMPLIFY | BLOB_NO_EXTERNAL_POINTS));
+    blob_context_t ref, ctx;
+    check_list_t list = { NULL, 0, 0 };
+    int i;
+    g_name = "BLOB_CHAIN_CODES";
+    check_reference(&ref, &list, c, c->image, flags);
+    check_context(&ctx, c, flags);
+    if( !find_blobs_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, c->image, (blob_coord_t)c->width, (blob_coord_t)c->height, flags | BLOB_CHAIN_CODES) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    for(i=0; i<ctx.count; i++)
+    {
+        const contour_t *contour = &ctx.blobs[i].external;
+        if((contour->count > 1) && (NULL == contour->codes))
+        {
+            CHECK_FAIL("blob (%d,%d) has no chain codes", ctx.blobs[i].x, ctx.blobs[i].y);
+        }
+    }
+    check_result(&ref, &list, &ctx, CHECK_ALL, flags | BLOB_CHAIN_CODES, 1);
+    check_release(&list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+}
+
+/* The blobs are written to a binary blob set, which is opened again and
+   compared with them. */
+static void check_file(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_ALL_FLAGS) | BLOB_SECOND_ORDER;
+    blob_context_t ref;
+    check_list_t ref_list = { NULL, 0, 0 }, list = { NULL, 0, 0 };
+    blob_file_t file;
+    uint64_t *buffer;
+    size_t size;
+    uint32_t i, j;
+    g_name = "blob_file";
+    check_reference(&ref, &ref_list, c, c->image, flags);
+    size = blob_file_size(ref.blobs, ref.count, flags);
+    buffer = (uint64_t*)check_alloc(size);
+    if(size != blob_file_write(ref.blobs, ref.count, flags, buffer, size))
+    {
+        CHECK_FAIL("blob_file_write failed (flags %x)", flags);
+    }
+    else if(!blob_file_open(&file, buffer, size))
+    {
+        CHECK_FAIL("blob_file_open failed (flags %x)", flags);
+    }
+    else
+    {
+        for(i=0; i<file.header->count; i++)
+        {
+            const blob_file_blob_t *r = file.blobs + i;
+            check_blob_t *b = check_push(&list);
+            b->label = r->label;
+            b->x = r->x;
+            b->y = r->y;
+            b->cls = r->cls;
+            b->internal_count = r->internal_count;
+            b->features.perimeter = r->perimeter;
+            b->features.area = r->area;
+            b->features.min_x = (blob_coord_t)r->min_x;
+            b->features.min_y = (blob_coord_t)r->min_y;
+            b->features.max_x = (blob_coord_t)r->max_x;
+            b->features.max_y = (blob_coord_t)r->max_y;
+            b->features.sum_x = r->sum_x;
+            b->features.sum_y = r->sum_y;
+            b->features.sum_xx = r->sum_xx;
+            b->features.sum_yy = r->sum_yy;
+            b->features.sum_xy = r->sum_xy;
+            /* The external contour is always stored, even without points. */
+            for(j=(flags & (BLOB_NO_EXTERNAL_POINTS | BLOB_TWO_PASS)) ? 1 : 0; j<r->contour_count; j++)
+            {
+                const blob_file_contour_t *f = file.contours + r->contour + j;
+                contour_t contour;
+                memset(&contour, 0, sizeof(contour));
+                contour.count = (int)f->count;
+                contour.points = (blob_coord_t*)(file.points + (2 * f->offset));
+                check_contour(b, &contour);
+            }
+        }
+        check_compare(&ref_list, &list, CHECK_ALL & ~CHECK_TREE, flags);
+    }
+    check_release(&list);
+    check_release(&ref_list);
+    blob_context_destroy(&ref);
+    free(buffer);
+}
+
+/* The contours traced with BLOB_SIMPLIFY must be the subsequence of the
+   full contours made of their first and last points and of the points
+   where the direction changes. */
+static void check_simplify(const check_case_t *c)
+{
+    int flags = check_flags(CHECK_TRACE_FLAGS & ~(BLOB_CHAIN_CODES | BLOB_SIMPLIFY));
+    blob_context_t ref, ctx;
+    check_list_t list = { NULL, 0, 0 };
+    int i, j, k, n;
+    g_name = "BLOB_SIMPLIFY";
+    check_reference(&ref, &list, c, c->image, flags);
+    for(i=0; i<list.count; i++)
+    {
+        check_blob_t *b = list.blobs + i;
+        blob_coord_t *src = b->points, *dst = b->points;
+        for(k=0, b->point_count=0; k<b->contours; k++)
+        {
+            const int count = b->counts[k];
+            for(j=0, n=0; j<count; j++, src+=2)
+            {
+                if((j > 0) && (j < (count-1)) && ((src[0] - src[-2]) == (src[2] - src[0])) && ((src[1] - src[-1]) == (src[3] - src[1])))
+                {
+                    continue;
+                }
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst += 2;
+                n++;
+            }
+            b->counts[k] = n;
+            b->point_count += n;
+        }
+    }
+    check_context(&ctx, c, flags);
+    if( !find_blobs_ctx(&ctx, c->roi_x, c->roi_y, c->roi_w, c->roi_h, c->image, (blob_coord_t)c->width, (blob_coord_t)c->height, flags | BLOB_SIMPLIFY) )
+    {
+        CHECK_FAIL("failed (flags %x)", flags);
+    }
+    check_result(&ref, &list, &ctx, CHECK_ALL, flags | BLOB_SIMPLIFY, 1);
+    check_release(&list);
+    blob_context_destroy(&ctx);
+    blob_context_destroy(&ref);
+}
+
+int main(int argc, char **argv)
+{
+    static void (*const checks[])(const check_case_t*) =
+    {
+        check_mt,
+        check_1bpp,
+        check_rle,
+        check_batch,
+        check_stride,
+        check_range,
+        check_class,
+        check_cb,
+        check_stream,
+        check_update,
+        check_two_pass,
+        check_tree,
+        check_features,
+        check_chain_codes,
+        check_file,
+        check_simplify
+    };
+    int iterations = (argc > 1) ? atoi(argv[1]) : 200;
+    uint32_t seed = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 1;
+    int i, k;
+
+    for(i=0; i<iterations; i++, seed++)
+    {
+        for(k=0; k<(int)(sizeof(checks) / sizeof(checks[0])); k++)
+        {
+            check_case_t c;
+            g_seed = seed;
+            g_state = (seed * 2654435761u) + k + 1;
+            /* Tall enough images for several strips of the multi-threaded labelling. */
+            check_case(&c, 96, (checks[k] == check_mt) ? 192 : 64);
+            checks[k](&c);
+            free(c.image);
+        }
+    }
+    if(g_failures)
+    {
+        printf("%d failures\n", g_failures);
+        return EXIT_FAILURE;
+    }
+    printf("%d iterations passed\n", iterations);
+    return EXIT_SUCCESS;
+}
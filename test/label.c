@@ -2,6 +2,9 @@
  * (blob.plot) files containing the set of extracted blobs.
  * The GNUplot file can be plotted with :
  *     plot "blob.plot" lc variable with lines         
+ * The blobs can also be stored as a binary blob set (see blob_file_write).
+ * The labelling can be repeated on a sweep of ROIs, with a choice of entry
+ * point and flags, in order to profile the library on a given image.
  *
  * Licensed under the MIT License
  * (c) 2016-2023 Vincent Cruz
@@ -10,6 +13,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 
 #include <getopt.h>
 
@@ -67,7 +71,7 @@ void label_write_png(label_t *label, int width, int height, const char *filename
 void contour_write_json(contour_t *contour, const char *name, int depth, FILE *out)
 {
     int i;
-    int16_t *ptr = contour->points;
+    blob_coord_t *ptr = contour->points;
     char tab[16];
     
     memset(tab, ' ', depth*2);
@@ -128,10 +132,10 @@ int blob_write_json(blob_t *blobs, int count, const char *filename)
 }
 
 /* write contour as GNUplot data */
-void contour_write_plot(contour_t *contour, int16_t label, FILE *out)
+void contour_write_plot(contour_t *contour, int label, FILE *out)
 {
     int i;
-    int16_t *ptr = contour->points;
+    blob_coord_t *ptr = contour->points;
 
     for(i=contour->count; i>0; i--, ptr+=2)
     {
@@ -168,15 +172,39 @@ int blob_write_plot(blob_t *blobs, int count, const char *filename)
     return 1;
 }
 
-/* simple dummy threshold */
-void threshold(uint8_t *source, int width, int height, uint8_t v)
+/* write blobs in a binary blob set file */
+int blob_write_binary(blob_t *blobs, int count, int flags, const char *filename)
 {
-    int i;
-    for(i=width*height; i>0; i--)
+    int ret = 0;
+    size_t size = blob_file_size(blobs, count, flags);
+    /* 8 bytes aligned buffer. */
+    uint64_t *buffer = (uint64_t*)malloc(size);
+    FILE *out = fopen(filename, "wb");
+    if(NULL == out)
+    {
+        fprintf(stderr, "failed to open %s : %s\n", filename, strerror(errno));
+    }
+    else if(NULL == buffer)
+    {
+        fprintf(stderr, "failed to allocate %zu bytes\n", size);
+    }
+    else if(blob_file_write(blobs, count, flags, buffer, size))
+    {
+        if(fwrite(buffer, 1, size, out) == size)
+        {
+            ret = 1;
+        }
+        else
+        {
+            fprintf(stderr, "failed to write %s : %s\n", filename, strerror(errno));
+        }
+    }
+    if(NULL != out)
     {
-        uint8_t c = (*source >= v) ? 1 : 0;
-        *source++ = c;
+        fclose(out);
     }
+    free(buffer);
+    return ret;
 }
 
 void usage()
@@ -189,11 +217,91 @@ void usage()
             "--roi_y or -y : Y coordinate of the upper left corner of ROI (default: 0).\n"
             "--roi_w or -w : width of the ROI (default: input image width).\n"
             "--roi_h or -h : height of the ROI (default: input image height).\n"
+            "--binary or -b: write the blobs to a binary blob set file\n"
+            "                instead of blob.json and blob.plot.\n"
+            "--repeat or -r: number of times the image is labelled (default: 1).\n"
+            "--sweep or -s : label n ROIs, the k-th one being k/n of the ROI\n"
+            "                width and height (default: 1).\n"
+            "--backend or -B : entry point, one of\n"
+            "                range      find_blobs_range_ctx, thresholding while labelling (default),\n"
+            "                ctx        find_blobs_ctx on the thresholded image,\n"
+            "                mt         find_blobs_mt_ctx on the thresholded image,\n"
+            "                find_blobs find_blobs on the thresholded image, allocating at each call.\n"
+            "--mode or -m  : labelling mode, one of\n"
+            "                contours   external and internal contours (default),\n"
+            "                external   external contours only,\n"
+            "                labels     labels without contour points,\n"
+            "                features   contours and blob features,\n"
+            "                holes      external contours and hole count (BLOB_COUNT_HOLES),\n"
+            "                two_pass   labels only (BLOB_TWO_PASS),\n"
+            "                tree       contours and contour tree (BLOB_CONTOUR_TREE).\n"
+            "--threads or -t : number of strips of the mt backend (default: 4).\n"
+            "--no_output or -n : do not write any file, <out> is not needed.\n"
             "--help or -h  : displays this message.\n"
             "<in>          : input image.\n"
             "<out>         : output label image.\n");
 }
 
+#define BACKEND_RANGE      0
+#define BACKEND_CTX        1
+#define BACKEND_MT         2
+#define BACKEND_FIND_BLOBS 3
+
+static const char *backend_names[] = { "range", "ctx", "mt", "find_blobs" };
+
+static const struct
+{
+    const char *name;
+    int flags;
+} modes[] =
+{
+    { "contours", BLOB_EXTRACT_INTERNAL },
+    { "external", 0 },
+    { "labels",   BLOB_NO_EXTERNAL_POINTS },
+    { "features", BLOB_EXTRACT_INTERNAL | BLOB_FEATURES | BLOB_SECOND_ORDER },
+    { "holes",    BLOB_COUNT_HOLES },
+    { "two_pass", BLOB_TWO_PASS },
+    { "tree",     BLOB_EXTRACT_INTERNAL | BLOB_CONTOUR_TREE }
+};
+
+/* Return the monotonic time in nanoseconds. */
+static int64_t label_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/* Add the counters of a call. */
+static void stats_add(blob_stats_t *total, const blob_stats_t *stats)
+{
+    const uint64_t *src = (const uint64_t*)stats;
+    uint64_t *dst = (uint64_t*)total;
+    size_t i;
+    for(i=0; i<(sizeof(blob_stats_t) / sizeof(uint64_t)); i++)
+    {
+        dst[i] += src[i];
+    }
+}
+
+/* Print the counters averaged over a number of calls. They are all 0 if
+   the library was not built with BLOB_STATS. */
+static void stats_print(const blob_stats_t *total, int calls)
+{
+    if((0 == total->pixels) && (0 == total->scan_ns))
+    {
+        return;
+    }
+    printf("    scan %.3f ms, external contours %.3f ms, internal contours %.3f ms\n",
+           total->scan_ns / (1e6 * calls), total->external_ns / (1e6 * calls), total->internal_ns / (1e6 * calls));
+    printf("    pixels %.0f, contours %.0f + %.0f, tracer steps %.0f, reallocations %.0f (%.0f bytes)\n",
+           (double)total->pixels / calls,
+           (double)total->external_contours / calls, (double)total->internal_contours / calls,
+           (double)total->trace_steps / calls,
+           (double)(total->blob_reallocs + total->contour_reallocs) / calls,
+           (double)(total->blob_bytes + total->contour_bytes) / calls);
+}
+
 int main(int argc, char **argv)
 {
     int ret;
@@ -201,22 +309,42 @@ int main(int argc, char **argv)
     int width  = 0;
     int height = 0;
     uint8_t *image = NULL;
+    uint8_t *binarized = NULL;
     
-    label_t *label  = NULL;
-    int16_t label_width = 0;
-    int16_t label_height = 0;
-    
-    blob_t *blobs;
-    int blob_count;
+    blob_context_t ctx;
+
+    blob_coord_t roi_x, roi_y, roi_w, roi_h;
+    const char *binary = NULL;
 
-    int16_t roi_x, roi_y, roi_w, roi_h;
+    int repeat = 1;
+    int sweep = 1;
+    int backend = BACKEND_RANGE;
+    int mode = 0;
+    int threads = 4;
+    int output = 1;
 
-    char *short_options = "x:y:w:h:?";
+    /* Results of the last call. */
+    label_t *label = NULL;
+    blob_coord_t label_w = 0, label_h = 0;
+    blob_t *blobs = NULL;
+    int count = 0;
+
+    int64_t t;
+    int i, k;
+
+    char *short_options = "x:y:w:h:b:r:s:B:m:t:n?";
     struct option long_options[] = {
         {"roi_x", 1, 0, 'x'},
         {"roi_y", 1, 0, 'y'},
         {"roi_w", 1, 0, 'w'},
         {"roi_h", 1, 0, 'h'},
+        {"binary", 1, 0, 'b'},
+        {"repeat", 1, 0, 'r'},
+        {"sweep", 1, 0, 's'},
+        {"backend", 1, 0, 'B'},
+        {"mode", 1, 0, 'm'},
+        {"threads", 1, 0, 't'},
+        {"no_output", 0, 0, 'n'},
         {"help",  0, 0, '?'},
         { 0,      0, 0,  0 }
     };
@@ -241,6 +369,29 @@ int main(int argc, char **argv)
             case 'h':
                 roi_h = atoi(optarg);
                 break;
+            case 'b':
+                binary = optarg;
+                break;
+            case 'r':
+                repeat = atoi(optarg);
+                break;
+            case 's':
+                sweep = atoi(optarg);
+                break;
+            case 'B':
+                for(backend=0; (backend<4) && strcmp(optarg, backend_names[backend]); backend++)
+                {}
+                break;
+            case 'm':
+                for(mode=0; (mode<(int)(sizeof(modes)/sizeof(modes[0]))) && strcmp(optarg, modes[mode].name); mode++)
+                {}
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'n':
+                output = 0;
+                break;
             case '?':
                 usage();
                 return EXIT_SUCCESS;
@@ -251,47 +402,173 @@ int main(int argc, char **argv)
         }
     }
 
-    if((argc - optind) != 2)
+    if((argc - optind) != (output ? 2 : 1))
     {
         fprintf(stderr, "error: missing parameters\n");
         usage();
         return EXIT_FAILURE;
     }
+    if((repeat < 1) || (sweep < 1) || (threads < 1))
+    {
+        fprintf(stderr, "error: invalid repeat, sweep or threads count\n");
+        return EXIT_FAILURE;
+    }
+    if(backend >= 4)
+    {
+        fprintf(stderr, "error: invalid backend\n");
+        usage();
+        return EXIT_FAILURE;
+    }
+    if(mode >= (int)(sizeof(modes)/sizeof(modes[0])))
+    {
+        fprintf(stderr, "error: invalid mode\n");
+        usage();
+        return EXIT_FAILURE;
+    }
+    /* find_blobs only chooses whether the internal contours are extracted. */
+    if((BACKEND_FIND_BLOBS == backend) && (modes[mode].flags & ~BLOB_EXTRACT_INTERNAL))
+    {
+        fprintf(stderr, "error: the find_blobs backend only supports the contours and external modes\n");
+        return EXIT_FAILURE;
+    }
     
+    t = label_now();
     image = stbi_load(argv[optind], &width, &height, NULL, 1);
     if(NULL == image)
     {
         fprintf(stderr, "failed to read image : %s\n", argv[optind]);
         return EXIT_FAILURE;
     }
+    printf("decode: %dx%d in %.3f ms\n", width, height, (label_now() - t) / 1e6);
 
-    threshold(image, width, height, 128); 
+    /* The other backends need a thresholded image. */
+    if(BACKEND_RANGE != backend)
+    {
+        t = label_now();
+        binarized = (uint8_t*)malloc(width * height);
+        if(NULL == binarized)
+        {
+            fprintf(stderr, "failed to allocate %d bytes\n", width * height);
+            free(image);
+            return EXIT_FAILURE;
+        }
+        for(i=0; i<(width*height); i++)
+        {
+            binarized[i] = (image[i] >= 128);
+        }
+        printf("threshold: %.3f ms\n", (label_now() - t) / 1e6);
+    }
 
-    blobs = NULL;
-    blob_count = 0;
+    blob_context_init(&ctx);
     
     if(roi_w < 0) { roi_w = width; }
     if(roi_h < 0) { roi_h = height; }
     
-    ret = EXIT_FAILURE;
-    
-    if( find_blobs(roi_x, roi_y, roi_w, roi_h, image, width, height, &label, &label_width, &label_height, &blobs, &blob_count, 1) )
+    ret = EXIT_SUCCESS;
+
+    printf("backend %s, mode %s, %d call(s) per ROI\n", backend_names[backend], modes[mode].name, repeat);
+    for(k=1; (k<=sweep) && (EXIT_SUCCESS == ret); k++)
     {
-        label_write_png(label, label_width, label_height, argv[optind+1]);
-        if(    blob_write_json(blobs, blob_count, "blob.json")
-            && blob_write_plot(blobs, blob_count, "blob.plot") )
+        const blob_coord_t w = (blob_coord_t)(((int64_t)roi_w * k) / sweep);
+        const blob_coord_t h = (blob_coord_t)(((int64_t)roi_h * k) / sweep);
+        const int flags = modes[mode].flags;
+        int64_t elapsed, total = 0, best = 0;
+        blob_stats_t stats;
+
+        memset(&stats, 0, sizeof(blob_stats_t));
+        for(i=0; i<repeat; i++)
         {
-            ret = EXIT_SUCCESS;
+            int ok = 0;
+            if(BACKEND_FIND_BLOBS == backend)
+            {
+                destroy_blobs(blobs, count);
+                free(label);
+                blobs = NULL;
+                label = NULL;
+                count = 0;
+            }
+            t = label_now();
+            switch(backend)
+            {
+                case BACKEND_RANGE:
+                    /* the image is thresholded while it is labelled. */
+                    ok = find_blobs_range_ctx(&ctx, roi_x, roi_y, w, h, image, width, height, 0, 128, 255, flags);
+                    break;
+                case BACKEND_CTX:
+                    ok = find_blobs_ctx(&ctx, roi_x, roi_y, w, h, binarized, width, height, flags);
+                    break;
+                case BACKEND_MT:
+                    ok = find_blobs_mt_ctx(&ctx, roi_x, roi_y, w, h, binarized, width, height, flags, threads);
+                    break;
+                default:
+                    ok = find_blobs(roi_x, roi_y, w, h, binarized, width, height, &label, &label_w, &label_h, &blobs, &count, flags & BLOB_EXTRACT_INTERNAL);
+                    break;
+            }
+            elapsed = label_now() - t;
+            if(!ok)
+            {
+                ret = EXIT_FAILURE;
+                break;
+            }
+            total += elapsed;
+            if((0 == i) || (elapsed < best))
+            {
+                best = elapsed;
+            }
+            if(BACKEND_FIND_BLOBS == backend)
+            {
+                blob_stats_t last;
+                find_blobs_stats(&last);
+                stats_add(&stats, &last);
+            }
+            else
+            {
+                stats_add(&stats, &ctx.stats);
+                label   = ctx.label;
+                label_w = ctx.label_w;
+                label_h = ctx.label_h;
+                count   = ctx.count;
+            }
         }
+        if(EXIT_SUCCESS != ret)
+        {
+            break;
+        }
+        printf("roi %dx%d: %d blobs, mean %.3f ms, min %.3f ms, %.1f Mpixels/s\n",
+               label_w, label_h, count, total / (1e6 * repeat), best / 1e6,
+               ((double)label_w * label_h * repeat * 1e3) / (double)(total ? total : 1));
+        stats_print(&stats, repeat);
     }
-    
-    destroy_blobs(blobs, blob_count);
-    
-    if(NULL != label)
+
+    if((EXIT_SUCCESS == ret) && output)
+    {
+        blob_t *out = (BACKEND_FIND_BLOBS == backend) ? blobs : ctx.blobs;
+        const int out_flags = modes[mode].flags & BLOB_EXTRACT_INTERNAL;
+        t = label_now();
+        label_write_png(label, label_w, label_h, argv[optind+1]);
+        if(NULL != binary)
+        {
+            if( !blob_write_binary(out, count, out_flags, binary) )
+            {
+                ret = EXIT_FAILURE;
+            }
+        }
+        else if(    !blob_write_json(out, count, "blob.json")
+                 || !blob_write_plot(out, count, "blob.plot") )
+        {
+            ret = EXIT_FAILURE;
+        }
+        printf("output: %.3f ms\n", (label_now() - t) / 1e6);
+    }
+
+    if(BACKEND_FIND_BLOBS == backend)
     {
+        destroy_blobs(blobs, count);
         free(label);
     }
+    blob_context_destroy(&ctx);
 
+    free(binarized);
     free(image);
 
     return ret;
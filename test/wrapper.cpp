@@ -0,0 +1,243 @@
+/* Compares blob::workspace::find_if on uint8_t, uint16_t and float images
+ * with find_blobs_ctx on the mask of the same predicate, and checks that
+ * moved workspaces and results keep their blobs.
+ *
+ * Usage: blob_wrapper [iterations] [seed]
+ *
+ * Licensed under the MIT License
+ * (c) 2016-2024 Vincent Cruz
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+#include <blob.hpp>
+
+namespace {
+
+const char *g_name = "";
+uint32_t g_seed = 0;
+int g_failures = 0;
+
+/* Report a failure of the current check. */
+#define CHECK_FAIL(...) \
+do { \
+    if(g_failures++ < 20) \
+    { \
+        std::printf("%s (seed %u): ", g_name, g_seed); \
+        std::printf(__VA_ARGS__); \
+        std::printf("\n"); \
+    } \
+} while(0)
+
+/* Simple deterministic random number generator (xorshift32). */
+uint32_t g_state = 1;
+
+int check_rand(int n)
+{
+    g_state ^= g_state << 13;
+    g_state ^= g_state >> 17;
+    g_state ^= g_state << 5;
+    return static_cast<int>(g_state % static_cast<uint32_t>(n));
+}
+
+/* Random image whose rows may be padded, and ROI which may lie partially
+   outside of it. */
+template <typename Pixel>
+struct check_image
+{
+    std::vector<Pixel> pixels;
+    int width, height, stride;
+    blob_coord_t roi_x, roi_y, roi_w, roi_h;
+};
+
+/* Pixel values are drawn in [0, max], with some filled rectangles. */
+template <typename Pixel>
+check_image<Pixel> check_generate(Pixel max)
+{
+    check_image<Pixel> img;
+    img.width  = 1 + check_rand(64);
+    img.height = 1 + check_rand(48);
+    img.stride = img.width + check_rand(3);
+    img.pixels.resize(static_cast<size_t>(img.stride) * img.height);
+    const int density = check_rand(80);
+    for(Pixel &p : img.pixels)
+    {
+        p = (check_rand(100) < density) ? static_cast<Pixel>((max * check_rand(1001)) / 1000) : Pixel(0);
+    }
+    for(int k=check_rand(5); k>0; k--)
+    {
+        const int x0 = check_rand(img.width);
+        const int y0 = check_rand(img.height);
+        const int x1 = x0 + check_rand(img.width - x0);
+        const int y1 = y0 + check_rand(img.height - y0);
+        const Pixel value = static_cast<Pixel>((max * check_rand(1001)) / 1000);
+        for(int j=y0; j<=y1; j++)
+        {
+            for(int i=x0; i<=x1; i++)
+            {
+                img.pixels[i + (static_cast<size_t>(j) * img.stride)] = value;
+            }
+        }
+    }
+    if(check_rand(4))
+    {
+        img.roi_x = static_cast<blob_coord_t>(check_rand(img.width) - check_rand(4));
+        img.roi_y = static_cast<blob_coord_t>(check_rand(img.height) - check_rand(4));
+        img.roi_w = static_cast<blob_coord_t>(1 + check_rand(img.width + 4));
+        img.roi_h = static_cast<blob_coord_t>(1 + check_rand(img.height + 4));
+    }
+    else
+    {
+        img.roi_x = img.roi_y = 0;
+        img.roi_w = static_cast<blob_coord_t>(img.width);
+        img.roi_h = static_cast<blob_coord_t>(img.height);
+    }
+    return img;
+}
+
+/* Compare the blobs and the labels of a workspace with the ones of a context. */
+bool check_same(const blob::workspace &ws, const blob_context_t &ref, int flags)
+{
+    const std::span<const blob_t> blobs = ws.blobs();
+    if(blobs.size() != static_cast<size_t>(ref.count))
+    {
+        CHECK_FAIL("%zu blobs instead of %d", blobs.size(), ref.count);
+        return false;
+    }
+    for(size_t k=0; k<blobs.size(); k++)
+    {
+        const blob_t &a = blobs[k];
+        const blob_t &b = ref.blobs[k];
+        if((a.label != b.label) || (a.x != b.x) || (a.y != b.y) || (a.internal_count != b.internal_count))
+        {
+            CHECK_FAIL("blob %zu differs", k);
+            return false;
+        }
+        if(blob::holes(a).size() != ((flags & BLOB_EXTRACT_INTERNAL) ? static_cast<size_t>(b.internal_count) : 0))
+        {
+            CHECK_FAIL("blob %zu has %zu holes", k, blob::holes(a).size());
+            return false;
+        }
+        const std::span<const blob::point> points = blob::points(a.external);
+        if(points.size() != static_cast<size_t>(b.external.count))
+        {
+            CHECK_FAIL("blob %zu has %zu contour points instead of %d", k, points.size(), b.external.count);
+            return false;
+        }
+        for(size_t i=0; i<points.size(); i++)
+        {
+            if((points[i].x != b.external.points[2*i]) || (points[i].y != b.external.points[(2*i)+1]))
+            {
+                CHECK_FAIL("blob %zu: contour point %zu differs", k, i);
+                return false;
+            }
+        }
+    }
+    if((ws.width() != ref.label_w) || (ws.height() != ref.label_h))
+    {
+        CHECK_FAIL("%dx%d labels instead of %dx%d", ws.width(), ws.height(), ref.label_w, ref.label_h);
+        return false;
+    }
+    const std::span<const label_t> labels = ws.labels();
+    for(size_t i=0; i<labels.size(); i++)
+    {
+        if(labels[i] != ref.label[i])
+        {
+            CHECK_FAIL("label %zu differs", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Label an image with find_if, and its mask with find_blobs_ctx. */
+template <typename Predicate, typename Pixel>
+void check_find_if(const char *name, Pixel max)
+{
+    g_name = name;
+    const check_image<Pixel> img = check_generate<Pixel>(max);
+    const int flags = check_rand(2) ? BLOB_EXTRACT_INTERNAL : 0;
+    const Predicate pred;
+
+    std::vector<uint8_t> mask(static_cast<size_t>(img.width) * img.height);
+    for(int j=0; j<img.height; j++)
+    {
+        for(int i=0; i<img.width; i++)
+        {
+            mask[i + (static_cast<size_t>(j) * img.width)] = pred(img.pixels[i + (static_cast<size_t>(j) * img.stride)]) ? 1 : 0;
+        }
+    }
+    blob_context_t ref;
+    blob_context_init(&ref);
+    blob::workspace ws;
+    if(!find_blobs_ctx(&ref, img.roi_x, img.roi_y, img.roi_w, img.roi_h, mask.data(), img.width, img.height, flags))
+    {
+        CHECK_FAIL("find_blobs_ctx failed");
+    }
+    else if(!ws.find_if<Predicate>(img.roi_x, img.roi_y, img.roi_w, img.roi_h, img.pixels.data(), img.width, img.height,
+                                   img.stride * static_cast<int>(sizeof(Pixel)), flags))
+    {
+        CHECK_FAIL("find_if failed");
+    }
+    else if(check_same(ws, ref, flags))
+    {
+        /* The blobs belong to the workspace they are moved to. */
+        blob::workspace moved(std::move(ws));
+        if(!ws.blobs().empty() || !check_same(moved, ref, flags))
+        {
+            CHECK_FAIL("the blobs were not moved");
+        }
+    }
+    blob_context_destroy(&ref);
+}
+
+/* Moving a result keeps its blobs and labels. */
+void check_result()
+{
+    g_name = "result";
+    check_image<uint8_t> img = check_generate<uint8_t>(1);
+    blob::result res;
+    if(!res.find(0, 0, img.width, img.height, img.pixels.data(), img.stride, img.height, false))
+    {
+        CHECK_FAIL("find_blobs failed");
+        return;
+    }
+    const size_t count = res.blobs().size();
+    const size_t labels = res.labels().size();
+    blob::result moved;
+    moved = std::move(res);
+    if(!res.blobs().empty() || !res.labels().empty() || (moved.blobs().size() != count) || (moved.labels().size() != labels))
+    {
+        CHECK_FAIL("the result was not moved");
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int iterations = (argc > 1) ? std::atoi(argv[1]) : 200;
+    uint32_t seed = (argc > 2) ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 0)) : 1;
+
+    for(int i=0; i<iterations; i++, seed++)
+    {
+        g_seed = seed;
+        g_state = (seed * 2654435761u) + 1;
+        check_find_if<blob::nonzero>("uint8_t nonzero", uint8_t(3));
+        check_find_if<blob::in_range<2, 5>>("uint8_t in_range", uint8_t(8));
+        check_find_if<blob::above<100>>("uint8_t above", uint8_t(255));
+        check_find_if<blob::above<1000>>("uint16_t above", uint16_t(4000));
+        check_find_if<blob::in_range<500, 3000>>("uint16_t in_range", uint16_t(4000));
+        check_find_if<blob::in_range<0.1f, 1.5f>>("float in_range", 2.0f);
+        check_result();
+    }
+    if(g_failures)
+    {
+        std::printf("%d failures\n", g_failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("%d iterations passed\n", iterations);
+    return EXIT_SUCCESS;
+}